@@ -3,9 +3,33 @@
 
 #include <limits>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <condition_variable>
+#include <exception>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NEXT_BDD_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace NextBdd {
 
@@ -23,117 +47,596 @@ namespace NextBdd {
   static inline ref  RefMax()                     { return std::numeric_limits<ref>::max();  }
   static inline size SizeMax()                    { return std::numeric_limits<size>::max(); }
   static inline uniq UniqHash(lit Arg0, lit Arg1) { return Arg0 + 4256249 * Arg1;            }
-  static inline cac  CacHash(lit Arg0, lit Arg1)  { return Arg0 + 4256249 * Arg1;            }
+  // hash for open tables, mixing the high bits
+  static inline size UniqHashOpen(lit Arg0, lit Arg1) {
+    return (size)Arg0 * 0x9E3779B97F4A7C15ull ^ (size)Arg1 * 0xC2B2AE3D27D4EB4Full;
+  }
+  // hash for the computed table
+  static inline cac  CacHash(lit Arg0, lit Arg1, lit Arg2) {
+    size h = (size)Arg0 * 0x9E3779B97F4A7C15ull ^ (size)Arg1 * 0xC2B2AE3D27D4EB4Full ^ (size)Arg2 * 0x165667B19E3779F9ull;
+    return (cac)(h ^ h >> 32);
+  }
+
+  // node storage reserved up front
+  template <typename T>
+  class Arena {
+  private:
+#ifdef NEXT_BDD_MMAP
+    T     *pData;
+    size_t nSize;
+    size_t nCap;
+    size_t nBytes;
+    size_t nPage;
+
+    // zero [i, nSize) and return its pages
+    void Release(size_t i) {
+      char *b = (char *)(pData + i);
+      char *e = (char *)(pData + nSize);
+      char *pb = (char *)(((uintptr_t)b + nPage - 1) & ~(uintptr_t)(nPage - 1));
+      char *pe = (char *)((uintptr_t)e & ~(uintptr_t)(nPage - 1));
+      if(pb < pe) {
+        memset(b, 0, pb - b);
+        if(madvise(pb, pe - pb, MADV_DONTNEED))
+          memset(pb, 0, pe - pb);
+        memset(pe, 0, e - pe);
+      } else
+        memset(b, 0, e - b);
+    }
+#else
+    std::vector<T> v;
+#endif
+
+  public:
+#ifdef NEXT_BDD_MMAP
+    Arena(): pData(NULL), nSize(0), nCap(0), nBytes(0), nPage(sysconf(_SC_PAGESIZE)) {}
+    ~Arena() {
+      if(pData)
+        munmap(pData, nBytes);
+    }
+    Arena(Arena const &) = delete;
+    Arena &operator=(Arena const &) = delete;
+    // nHugePage: 0 regular, 1 transparent, 2 explicit huge pages
+    void Reserve(size_t n, int nHugePage) {
+      if(pData)
+        throw std::logic_error("Arena is already reserved");
+      size_t huge = (size_t)1 << 21;
+      nBytes = (n * sizeof(T) + huge - 1) & ~(huge - 1);
+      void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+      if(nHugePage >= 2)
+        p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if(p != MAP_FAILED)
+        nPage = huge;
+#endif
+      if(p == MAP_FAILED) {
+        p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(p == MAP_FAILED)
+          throw std::length_error("Memout (reserve) in init");
+#ifdef MADV_HUGEPAGE
+        if(nHugePage)
+          madvise(p, nBytes, MADV_HUGEPAGE);
+#endif
+      }
+      pData = (T *)p;
+      nCap = n;
+    }
+    void resize(size_t n) {
+      if(n > nCap)
+        throw std::length_error("Memout (arena)");
+      if(n < nSize)
+        Release(n);
+      // read while the storage grows
+      __atomic_store_n(&nSize, n, __ATOMIC_RELAXED);
+    }
+    void clear()                             { resize(0);         }
+    // shrinking already returned the pages
+    void shrink_to_fit()                     {                    }
+    inline size_t   size()             const { return __atomic_load_n(&nSize, __ATOMIC_RELAXED); }
+    inline bool     empty()            const { return !size();    }
+    inline T       &operator[](size_t i)     { return pData[i];   }
+    inline T const &operator[](size_t i) const { return pData[i]; }
+#else
+    void Reserve(size_t n, int nHugePage)    { (void)n, (void)nHugePage; }
+    void resize(size_t n)                    { v.resize(n);       }
+    void clear()                             { v.clear();         }
+    void shrink_to_fit()                     { v.shrink_to_fit(); }
+    inline size_t   size()             const { return v.size();   }
+    inline bool     empty()            const { return v.empty();  }
+    inline T       &operator[](size_t i)     { return v[i];       }
+    inline T const &operator[](size_t i) const { return v[i];     }
+#endif
+  };
+
+  // operations sharing the computed table
+  enum Op { OpAnd, OpXor, OpIte, OpExist, OpAndExist, OpNum };
+  static inline char const *OpName(int o) {
+    static char const *names[] = {"And", "Xor", "Ite", "Exist", "AndEx"};
+    return names[o];
+  }
+
+  // node and cache entry budget shared by managers
+  class Budget {
+  private:
+    std::atomic<size> nNodes;
+    std::atomic<size> nEntries;
+
+    static bool Take(std::atomic<size> &n, size k) {
+      size m = n.load();
+      while(m >= k)
+        if(n.compare_exchange_weak(m, m - k))
+          return true;
+      return false;
+    }
+
+  public:
+    Budget(size nNodes, size nEntries): nNodes(nNodes), nEntries(nEntries) {}
+    bool BorrowNodes(size k)         { return Take(nNodes, k);   }
+    void ReturnNodes(size k)         { nNodes += k;              }
+    bool BorrowEntries(size k)       { return Take(nEntries, k); }
+    void ReturnEntries(size k)       { nEntries += k;            }
+    size NodesLeft()           const { return nNodes.load();     }
+    size EntriesLeft()         const { return nEntries.load();   }
+  };
+
+  // cache slot
+  struct alignas(16) CacEntry {
+    lit x;
+    lit y;
+    lit z;
+    lit r;
+  };
+  // cache line
+  struct alignas(64) CacLine {
+    CacEntry e[4];
+  };
 
+  // computed table, ways ordered by age
   class Cache {
   private:
+    static int const OpShift = 28;
     cac    nSize;
     cac    nMax;
     cac    Mask;
+    int    nWays;
+    double MinGain;
     size   nLookups;
     size   nHits;
     size   nThold;
-    double HitRate;
+    size   nLookupsLast;
+    size   nOldHitsLast;
+    size   nInserts;
+    size   nEvicts;
+    size   nGrows;
     int    nVerbose;
-    std::vector<lit> vCache;
+    Budget *pBudget;
+    size   vOpLookups[OpNum];
+    size   vOpHits[OpNum];
+    size   vWayHits[4];
+    std::vector<CacLine>  vLines;
+    std::vector<unsigned> vSeqs;
+
+    // no room for the opcode
+    static inline lit Tag(int o, lit z) {
+      if(z >> OpShift)
+        return LitMax();
+      return z | (lit)o << OpShift;
+    }
+    static inline bool IsEmpty(CacEntry const &e) { return !(e.x || e.y || e.z); }
+    static inline CacEntry LoadPar(CacEntry const &e) {
+      CacEntry v;
+      v.x = __atomic_load_n(&e.x, __ATOMIC_RELAXED);
+      v.y = __atomic_load_n(&e.y, __ATOMIC_RELAXED);
+      v.z = __atomic_load_n(&e.z, __ATOMIC_RELAXED);
+      v.r = __atomic_load_n(&e.r, __ATOMIC_RELAXED);
+      return v;
+    }
+    static inline void StorePar(CacEntry &e, CacEntry const &v) {
+      __atomic_store_n(&e.x, v.x, __ATOMIC_RELAXED);
+      __atomic_store_n(&e.y, v.y, __ATOMIC_RELAXED);
+      __atomic_store_n(&e.z, v.z, __ATOMIC_RELAXED);
+      __atomic_store_n(&e.r, v.r, __ATOMIC_RELAXED);
+    }
+    inline CacEntry *Set(cac j) { return reinterpret_cast<CacEntry *>(vLines.data()) + (size_t)j * nWays; }
+    // the first empty way, or the oldest one
+    inline int Victim(CacEntry const *s) const {
+      int i = 0;
+      while(i < nWays - 1 && !IsEmpty(s[i]))
+        i++;
+      return i;
+    }
+    // grow when the oldest-way hits pay for it
+    void Check() {
+      size nWindow = nLookups - nLookupsLast;
+      double Gain = (double)(vWayHits[nWays - 1] - nOldHitsLast) / nWindow;
+      double Cost = pBudget? (double)nSize / (nSize + pBudget->EntriesLeft()): (double)(nSize << 1) / nMax;
+      if(nVerbose >= 2)
+        std::cout << "Cache Hits: " << std::setw(10) << nHits << ", "
+                  << "Lookups: " << std::setw(10) << nLookups << ", "
+                  << "Rate: " << std::setw(10) << (double)nHits / nLookups << ", "
+                  << "Oldest: " << std::setw(10) << Gain
+                  << std::endl;
+      if(nSize < nMax && Gain >= MinGain * Cost && (!pBudget || pBudget->BorrowEntries(nSize)))
+        Resize();
+      if(nSize == nMax)
+        nThold = SizeMax();
+      else {
+        nThold <<= 1;
+        if(!nThold)
+          nThold = SizeMax();
+      }
+      nLookupsLast = nLookups;
+      nOldHitsLast = vWayHits[nWays - 1];
+    }
+    inline void InsertInt(cac j, CacEntry const &e) {
+      CacEntry *s = Set(j);
+      int i = Victim(s);
+      nInserts++;
+      nEvicts += !IsEmpty(s[i]);
+      for(; i > 0; i--)
+        s[i] = s[i - 1];
+      s[0] = e;
+    }
 
   public:
-    Cache(int nCacheSizeLog, int nCacheMaxLog, int nVerbose): nVerbose(nVerbose) {
+    Cache(int nCacheSizeLog, int nCacheMaxLog, int nWays, double MinGain, int nVerbose, Budget *pBudget = NULL): nWays(nWays), MinGain(MinGain), nVerbose(nVerbose), pBudget(pBudget) {
       if(nCacheMaxLog < nCacheSizeLog)
         throw std::invalid_argument("nCacheMax must not be smaller than nCacheSize");
+      if(nWays != 1 && nWays != 2 && nWays != 4)
+        throw std::invalid_argument("nCacheWays must be 1, 2 or 4");
       nMax = (cac)1 << nCacheMaxLog;
       if(!(nMax << 1))
         throw std::length_error("Memout (nCacheMax) in init");
       nSize = (cac)1 << nCacheSizeLog;
+      if(nSize < (cac)nWays)
+        throw std::invalid_argument("nCacheSize must not be smaller than nCacheWays");
       if(nVerbose)
         std::cout << "Allocating " << nSize << " cache entries" << std::endl;
-      vCache.resize(nSize * 3);
-      Mask = nSize - 1;
+      vLines.resize((nSize + 3) / 4);
+      if(pBudget && !pBudget->BorrowEntries(nSize))
+        throw std::length_error("Memout (budget) in init");
+      Mask = nSize / nWays - 1;
       nLookups = 0;
       nHits = 0;
+      for(int o = 0; o < OpNum; o++)
+        vOpLookups[o] = vOpHits[o] = 0;
+      for(int i = 0; i < 4; i++)
+        vWayHits[i] = 0;
       nThold = (nSize == nMax)? SizeMax(): nSize;
-      HitRate = 1;
+      nLookupsLast = nOldHitsLast = 0;
+      nInserts = nEvicts = nGrows = 0;
     }
     ~Cache() {
       if(nVerbose)
         std::cout << "Free " << nSize << " cache entries" << std::endl;
+      if(pBudget)
+        pBudget->ReturnEntries(nSize);
     }
-    inline lit Lookup(lit x, lit y) {
+    inline lit Lookup(int o, lit x, lit y, lit z = 0) {
+      z = Tag(o, z);
+      if(z == LitMax())
+        return LitMax();
       nLookups++;
-      if(nLookups > nThold) {
-        double NewHitRate = (double)nHits / nLookups;
-        if(nVerbose >= 2)
-          std::cout << "Cache Hits: " << std::setw(10) << nHits << ", "
-                    << "Lookups: " << std::setw(10) << nLookups << ", "
-                    << "Rate: " << std::setw(10) << NewHitRate
-                    << std::endl;
-        if(NewHitRate > HitRate)
-          Resize();
-        if(nSize == nMax)
-          nThold = SizeMax();
-        else {
-          nThold <<= 1;
-          if(!nThold)
-            nThold = SizeMax();
-        }
-        HitRate = NewHitRate;
-      }
-      cac i = (CacHash(x, y) & Mask) * 3;
-      if(vCache[i] == x && vCache[i + 1] == y) {
+      vOpLookups[o]++;
+      if(nLookups > nThold)
+        Check();
+      CacEntry *s = Set(CacHash(x, y, z) & Mask);
+      for(int i = 0; i < nWays; i++) {
+        if(s[i].x != x || s[i].y != y || s[i].z != z)
+          continue;
+        lit r = s[i].r;
         if(nVerbose >= 3)
           std::cout << "Cache hit: "
+                    << "op = " << std::setw(6) << OpName(o) << ", "
                     << "x = " << std::setw(10) << x << ", "
                     << "y = " << std::setw(10) << y << ", "
-                    << "z = " << std::setw(10) << vCache[i + 2] << ", "
-                    << "hash = " << std::hex << (CacHash(x, y) & Mask) << std::dec
+                    << "z = " << std::setw(10) << (z & ~((lit)o << OpShift)) << ", "
+                    << "r = " << std::setw(10) << r << ", "
+                    << "set = " << std::hex << (CacHash(x, y, z) & Mask) << std::dec << ", "
+                    << "way = " << i
                     << std::endl;
         nHits++;
-        return vCache[i + 2];
+        vOpHits[o]++;
+        vWayHits[i]++;
+        if(i)
+          std::swap(s[i], s[i - 1]);
+        return r;
       }
       return LitMax();
     }
-    inline void Insert(lit x, lit y, lit z) {
-      cac i = (CacHash(x, y) & Mask) * 3;
-      vCache[i] = x;
-      vCache[i + 1] = y;
-      vCache[i + 2] = z;
+    inline void Insert(int o, lit x, lit y, lit r) {
+      Insert(o, x, y, 0, r);
+    }
+    inline void Insert(int o, lit x, lit y, lit z, lit r) {
+      z = Tag(o, z);
+      if(z == LitMax())
+        return;
+      CacEntry e = {x, y, z, r};
+      InsertInt(CacHash(x, y, z) & Mask, e);
       if(nVerbose >= 3)
         std::cout << "Cache ent: "
+                  << "op = " << std::setw(6) << OpName(o) << ", "
                   << "x = " << std::setw(10) << x << ", "
                   << "y = " << std::setw(10) << y << ", "
-                  << "z = " << std::setw(10) << z << ", "
-                  << "hash = " << std::hex << (CacHash(x, y) & Mask) << std::dec
+                  << "z = " << std::setw(10) << (z & ~((lit)o << OpShift)) << ", "
+                  << "r = " << std::setw(10) << r << ", "
+                  << "set = " << std::hex << (CacHash(x, y, z) & Mask) << std::dec
                   << std::endl;
     }
     inline void Clear() {
-      std::fill(vCache.begin(), vCache.end(), 0);
+      std::fill(vLines.begin(), vLines.end(), CacLine());
     }
+    // drop only the entries that refer to a freed node
+    template <typename F>
+    void Invalidate(F fFreed) {
+      lit zMask = ((lit)1 << OpShift) - 1;
+      CacEntry *p = Set(0);
+      for(cac j = 0; j < nSize; j++) {
+        CacEntry &e = p[j];
+        if(fFreed(e.x) || fFreed(e.y) || fFreed(e.z & zMask) || fFreed(e.r))
+          e = CacEntry();
+      }
+    }
+    // lossy lookup/insert for concurrent use
+    void SetConcurrent() {
+      vSeqs.clear();
+      vSeqs.resize(Mask + 1);
+    }
+    inline lit LookupPar(int o, lit x, lit y, lit z = 0) {
+      z = Tag(o, z);
+      if(z == LitMax())
+        return LitMax();
+      cac j = CacHash(x, y, z) & Mask;
+      unsigned s = __atomic_load_n(&vSeqs[j], __ATOMIC_ACQUIRE);
+      if(s & 1)
+        return LitMax();
+      CacEntry *p = Set(j);
+      lit r = LitMax();
+      for(int i = 0; i < nWays; i++) {
+        CacEntry e = LoadPar(p[i]);
+        if(e.x == x && e.y == y && e.z == z) {
+          r = e.r;
+          break;
+        }
+      }
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if(__atomic_load_n(&vSeqs[j], __ATOMIC_RELAXED) != s)
+        return LitMax();
+      return r;
+    }
+    inline void InsertPar(int o, lit x, lit y, lit r) {
+      InsertPar(o, x, y, 0, r);
+    }
+    inline void InsertPar(int o, lit x, lit y, lit z, lit r) {
+      z = Tag(o, z);
+      if(z == LitMax())
+        return;
+      cac j = CacHash(x, y, z) & Mask;
+      unsigned s = __atomic_load_n(&vSeqs[j], __ATOMIC_RELAXED);
+      if((s & 1) || !__atomic_compare_exchange_n(&vSeqs[j], &s, s + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+      CacEntry *p = Set(j);
+      int i = 0;
+      while(i < nWays - 1 && !IsEmpty(LoadPar(p[i])))
+        i++;
+      for(; i > 0; i--)
+        StorePar(p[i], LoadPar(p[i - 1]));
+      CacEntry e = {x, y, z, r};
+      StorePar(p[0], e);
+      __atomic_store_n(&vSeqs[j], s + 2, __ATOMIC_RELEASE);
+    }
+    // move entries, oldest first
     void Resize() {
-      cac nSizeOld = nSize;
+      cac nSetsOld = Mask + 1;
       nSize <<= 1;
+      nGrows++;
       if(nVerbose >= 2)
         std::cout << "Reallocating " << nSize << " cache entries" << std::endl;
-      vCache.resize(nSize * 3);
-      Mask = nSize - 1;
-      for(cac j = 0; j < nSizeOld; j++) {
-        cac i = j * 3;
-        if(vCache[i] || vCache[i + 1]) {
-          cac hash = (CacHash(vCache[i], vCache[i + 1]) & Mask) * 3;
-          vCache[hash] = vCache[i];
-          vCache[hash + 1] = vCache[i + 1];
-          vCache[hash + 2] = vCache[i + 2];
+      std::vector<CacLine> vLinesOld((nSize + 3) / 4);
+      vLines.swap(vLinesOld);
+      if(!vSeqs.empty())
+        vSeqs.resize(nSize / nWays);
+      Mask = nSize / nWays - 1;
+      CacEntry const *pOld = reinterpret_cast<CacEntry const *>(vLinesOld.data());
+      size nInserts_ = nInserts, nEvicts_ = nEvicts;
+      for(cac j = 0; j < nSetsOld; j++)
+        for(int i = nWays - 1; i >= 0; i--) {
+          CacEntry const &e = pOld[(size_t)j * nWays + i];
+          if(IsEmpty(e))
+            continue;
+          cac hash = CacHash(e.x, e.y, e.z) & Mask;
+          InsertInt(hash, e);
           if(nVerbose >= 3)
             std::cout << "Cache mov: "
-                      << "x = " << std::setw(10) << vCache[i] << ", "
-                      << "y = " << std::setw(10) << vCache[i + 1] << ", "
-                      << "z = " << std::setw(10) << vCache[i + 2] << ", "
-                      << "hash = " << std::hex << (CacHash(vCache[i], vCache[i + 1]) & Mask) << std::dec
+                      << "x = " << std::setw(10) << e.x << ", "
+                      << "y = " << std::setw(10) << e.y << ", "
+                      << "z = " << std::setw(10) << e.z << ", "
+                      << "r = " << std::setw(10) << e.r << ", "
+                      << "set = " << std::hex << hash << std::dec
                       << std::endl;
         }
+      nInserts = nInserts_, nEvicts = nEvicts_;
+    }
+    void PrintStats() const {
+      for(int o = 0; o < OpNum; o++) {
+        if(!vOpLookups[o])
+          continue;
+        std::cout << std::setw(6) << OpName(o) << ": "
+                  << "lookups: " << std::setw(10) << vOpLookups[o] << ", "
+                  << "hits: " << std::setw(10) << vOpHits[o] << ", "
+                  << "rate: " << std::setw(10) << (double)vOpHits[o] / vOpLookups[o]
+                  << std::endl;
+      }
+      if(!nLookups)
+        return;
+      std::cout << " cache: " << nSize << " entries in " << nWays << " ways, "
+                << "grown " << nGrows << " times, "
+                << "hits by age:";
+      for(int i = 0; i < nWays; i++)
+        std::cout << " " << vWayHits[i];
+      std::cout << ", evicted: " << nEvicts << " of " << nInserts << " inserts" << std::endl;
+    }
+  };
+
+  class TaskPool {
+  public:
+    struct Task {
+      std::function<void()> f;
+      std::atomic<bool>     fDone{false};
+    };
+
+  private:
+    struct Queue {
+      std::mutex         m;
+      std::deque<Task *> d;
+    };
+    int                      nThreads;
+    std::vector<Queue>       vQueues;
+    std::vector<std::thread> vWorkers;
+    std::atomic<bool>        fRunning;
+    std::atomic<bool>        fStop;
+    std::atomic<size_t>      nPending;
+    std::atomic<int>         nIdle;
+    std::mutex               m;
+    std::condition_variable  cv;
+
+    static int &ThreadId() {
+      static thread_local int id = 0;
+      return id;
+    }
+    // owner pops from the back, thieves take from the front
+    Task *Pop(int id) {
+      std::lock_guard<std::mutex> l(vQueues[id].m);
+      if(vQueues[id].d.empty())
+        return NULL;
+      Task *t = vQueues[id].d.back();
+      vQueues[id].d.pop_back();
+      nPending--;
+      return t;
+    }
+    Task *Steal(int id) {
+      for(int k = 1; k < nThreads; k++) {
+        Queue &q = vQueues[(id + k) % nThreads];
+        std::lock_guard<std::mutex> l(q.m);
+        if(q.d.empty())
+          continue;
+        Task *t = q.d.front();
+        q.d.pop_front();
+        nPending--;
+        return t;
+      }
+      return NULL;
+    }
+    static void Execute(Task *t) {
+      t->f();
+      t->fDone.store(true, std::memory_order_release);
+    }
+    void Work(int id) {
+      ThreadId() = id;
+      while(true) {
+        {
+          std::unique_lock<std::mutex> l(m);
+          cv.wait(l, [&] { return fRunning.load() || fStop.load(); });
+          if(fStop)
+            return;
+        }
+        // spin, then sleep
+        int nFails = 0;
+        while(fRunning.load(std::memory_order_relaxed)) {
+          Task *t = Steal(id);
+          if(t) {
+            Execute(t);
+            nFails = 0;
+          } else if(++nFails < 64)
+            std::this_thread::yield();
+          else {
+            std::unique_lock<std::mutex> l(m);
+            nIdle++;
+            cv.wait(l, [&] { return nPending.load() || !fRunning.load() || fStop.load(); });
+            nIdle--;
+            nFails = 0;
+          }
+        }
+      }
+    }
+
+  public:
+    TaskPool(int nThreads): nThreads(nThreads), vQueues(nThreads), fRunning(false), fStop(false), nPending(0), nIdle(0) {
+      for(int id = 1; id < nThreads; id++)
+        vWorkers.emplace_back(&TaskPool::Work, this, id);
+    }
+    ~TaskPool() {
+      {
+        std::lock_guard<std::mutex> l(m);
+        fStop = true;
+      }
+      cv.notify_all();
+      for(size_t i = 0; i < vWorkers.size(); i++)
+        vWorkers[i].join();
+    }
+    // run f with the workers
+    void Run(std::function<void()> const &f) {
+      int id = ThreadId();
+      ThreadId() = 0;
+      {
+        std::lock_guard<std::mutex> l(m);
+        fRunning = true;
+      }
+      cv.notify_all();
+      f();
+      {
+        std::lock_guard<std::mutex> l(m);
+        fRunning = false;
+      }
+      cv.notify_all();
+      ThreadId() = id;
+    }
+    void Spawn(Task *t) {
+      int id = ThreadId();
+      {
+        std::lock_guard<std::mutex> l(vQueues[id].m);
+        vQueues[id].d.push_back(t);
+      }
+      nPending++;
+      // a worker going to sleep holds m while it checks nPending
+      if(nIdle.load()) {
+        { std::lock_guard<std::mutex> l(m); }
+        cv.notify_one();
+      }
+    }
+    // help until t is done
+    void Wait(Task *t) {
+      int id = ThreadId();
+      while(!t->fDone.load(std::memory_order_acquire)) {
+        Task *u = Pop(id);
+        if(!u)
+          u = Steal(id);
+        if(u)
+          Execute(u);
+        else
+          std::this_thread::yield();
       }
     }
+    // run f(i) for each i in [0, n) as independent tasks
+    void For(size_t n, std::function<void(size_t)> const &f) {
+      std::vector<Task> vTasks(n);
+      Run([&] {
+        for(size_t i = 0; i < n; i++) {
+          vTasks[i].f = [&f, i] { f(i); };
+          Spawn(&vTasks[i]);
+        }
+        for(size_t i = n; i > 0; i--)
+          Wait(&vTasks[i - 1]);
+      });
+    }
+    int Size() const { return nThreads; }
+    // index of the calling thread within a run
+    static int Id() { return ThreadId(); }
   };
 
+  // reordering methods
+  enum Reo { ReoSift, ReoWindow, ReoGroupSift, ReoSiftConv };
+
   struct Param {
     int    nObjsAllocLog  = 20;
     int    nObjsMaxLog    = 25;
@@ -141,17 +644,302 @@ namespace NextBdd {
     double UniqueDensity  = 4;
     int    nCacheSizeLog  = 15;
     int    nCacheMaxLog   = 20;
+    int    nCacheWays     = 4;
+    double CacheMinGain   = 0.05;
     int    nCacheVerbose  = 0;
-    bool   fCountOnes     = false;
     int    nGbc           = 0;
     bvar   nReo           = BvarMax();
     double MaxGrowth      = 1.2;
+    double ReoMinGain     = 0.1;
+    double ReoTimeLimit   = 0;
+    int    nReoGbcs       = 4;
     bool   fReoVerbose    = false;
+    bool   fReoPar        = false;
+    bool   fSiftBound     = false;
+    bool   fSiftCost      = false;
+    int    nReoMethod     = ReoSift;
+    int    nReoWindow     = 3;
+    double MinGain        = 0.01;
+    int    nThreads       = 1;
+    int    nTaskDepth     = 8;
+    int    nRecDepth      = 256;
+    int    nHugePage      = 0;
     int    nVerbose       = 0;
     std::vector<var> *pVar2Level = NULL;
+    Budget *pBudget = NULL;
+  };
+
+  // header of a file written by Man::Save
+  struct FileHeader {
+    char     Magic[4];
+    uint32_t nVersion;
+    uint32_t nVars;
+    uint32_t nWidth;
+    uint64_t nNodes;
+    uint64_t nRoots;
+  };
+
+  static inline uint64_t LoadLe(const unsigned char *p, unsigned n) {
+    uint64_t r = 0;
+    while(n--)
+      r = (r << 8) | p[n];
+    return r;
+  }
+  static inline void StoreLe(unsigned char *p, uint64_t r, unsigned n) {
+    for(unsigned i = 0; i < n; i++, r >>= 8)
+      p[i] = (unsigned char)r;
+  }
+
+  // saved file mapped read-only
+  class Image {
+  private:
+    const char     *pData;
+    size            nSize;
+    std::vector<char> vBuffer;
+    FileHeader      Header;
+    const unsigned char *pLevel2Var;
+    const unsigned char *pStarts;
+    const unsigned char *pRoots;
+    const unsigned char *pEdges;
+
+    static size Pad(size n) { return (n + 7) & ~(size)7; }
+    inline size Field(size i) const { return LoadLe(pEdges + i * Header.nWidth, Header.nWidth); }
+    inline size Start(size j) const { return LoadLe(pStarts + 8 * j, 8);                         }
+
+  public:
+    Image(std::string const &name) {
+      pData = NULL;
+      nSize = 0;
+#ifdef NEXT_BDD_MMAP
+      int fd = open(name.c_str(), O_RDONLY);
+      if(fd < 0)
+        throw std::runtime_error("Cannot open " + name);
+      struct stat st;
+      if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED)
+          pData = (const char *)p, nSize = st.st_size;
+      }
+      close(fd);
+      if(!pData)
+        throw std::runtime_error("Cannot map " + name);
+#else
+      std::ifstream f(name, std::ios::binary);
+      if(!f)
+        throw std::runtime_error("Cannot open " + name);
+      vBuffer.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+      pData = vBuffer.data();
+      nSize = vBuffer.size();
+#endif
+      if(!Validate()) {
+        Unmap();
+        throw std::runtime_error("Invalid BDD file " + name);
+      }
+    }
+    ~Image() {
+      Unmap();
+    }
+    Image(Image const &) = delete;
+    Image &operator=(Image const &) = delete;
+
+    inline var  NumVars()           const { return (var)Header.nVars;                      }
+    inline size NumNodes()          const { return Header.nNodes;                          }
+    inline size NumRoots()          const { return Header.nRoots;                          }
+    inline lit  Root(size i)        const { return (lit)LoadLe(pRoots + 8 * i, 8);         }
+    inline var  Level2Var(var lev)  const { return (var)LoadLe(pLevel2Var + 4 * lev, 4);   }
+    // nodes of level lev have the indices [Begin(lev), End(lev))
+    inline size Begin(var lev)      const { return Start(Header.nVars - 1 - lev);          }
+    inline size End(var lev)        const { return Start(Header.nVars - lev);              }
+    inline var  Level(lit x)        const {
+      size i = x >> 1, j = 0, n = (size)Header.nVars + 1;
+      while(n) {
+        size h = n >> 1;
+        if(Start(j + h) <= i)
+          j += h + 1, n -= h + 1;
+        else
+          n = h;
+      }
+      return (var)(Header.nVars - j);
+    }
+    inline var  Var(lit x)          const { return Level2Var(Level(x));                    }
+    inline lit  Then(lit x)         const {
+      size i = x >> 1, f = Field(2 * i - 2);
+      return (lit)(((i - (f >> 1)) << 1) | (f & 1)) ^ (x & 1);
+    }
+    inline lit  Else(lit x)         const {
+      size i = x >> 1;
+      return (lit)((i - Field(2 * i - 1)) << 1) ^ (x & 1);
+    }
+    bool Eval(lit x, std::vector<bool> const &vValues) const {
+      while(x >= 2)
+        x = vValues[Var(x)]? Then(x): Else(x);
+      return x;
+    }
+
+  private:
+    // decode the header and check every index
+    bool Validate() {
+      const unsigned char *p = (const unsigned char *)pData;
+      if(nSize < sizeof(FileHeader) || std::memcmp(p, "NBDD", 4))
+        return false;
+      std::memcpy(Header.Magic, p, 4);
+      Header.nVersion = (uint32_t)LoadLe(p + 4, 4);
+      Header.nVars = (uint32_t)LoadLe(p + 8, 4);
+      Header.nWidth = (uint32_t)LoadLe(p + 12, 4);
+      Header.nNodes = LoadLe(p + 16, 8);
+      Header.nRoots = LoadLe(p + 24, 8);
+      if(Header.nVersion != 1 || !Header.nWidth || Header.nWidth > 8 || Header.nVars > VarMax() || Header.nNodes > (LitMax() >> 1))
+        return false;
+      if(Header.nVars > nSize / 8 || Header.nRoots > nSize / 8 || Header.nNodes > nSize / (2 * Header.nWidth))
+        return false;
+      size offset = Pad(sizeof(FileHeader));
+      pLevel2Var = p + offset;
+      offset += Pad((size)Header.nVars * 4);
+      pStarts = p + offset;
+      offset += ((size)Header.nVars + 1) * 8;
+      pRoots = p + offset;
+      offset += Header.nRoots * 8;
+      pEdges = p + offset;
+      offset += Pad(2 * Header.nNodes * Header.nWidth);
+      if(offset != nSize)
+        return false;
+      std::vector<bool> vSeen(Header.nVars);
+      for(size lev = 0; lev < Header.nVars; lev++) {
+        size v = LoadLe(pLevel2Var + 4 * lev, 4);
+        if(v >= Header.nVars || vSeen[v])
+          return false;
+        vSeen[v] = true;
+      }
+      if(Start(0) != 1 || Start(Header.nVars) != Header.nNodes + 1)
+        return false;
+      for(size j = 0; j < Header.nVars; j++) {
+        if(Start(j) > Start(j + 1))
+          return false;
+        // both children of a node lie below its level
+        for(size k = Start(j); k < Start(j + 1); k++)
+          if((Field(2 * k - 2) >> 1) > k || k - (Field(2 * k - 2) >> 1) >= Start(j) ||
+             Field(2 * k - 1) > k || k - Field(2 * k - 1) >= Start(j))
+            return false;
+      }
+      for(size i = 0; i < Header.nRoots; i++)
+        if((LoadLe(pRoots + 8 * i, 8) >> 1) > Header.nNodes)
+          return false;
+      return true;
+    }
+    void Unmap() {
+#ifdef NEXT_BDD_MMAP
+      if(pData)
+        munmap((void *)pData, nSize);
+#endif
+      pData = NULL;
+    }
+  };
+
+  // AIGER writer with structural hashing
+  class AigWriter {
+  private:
+    unsigned nInputs;
+    std::vector<unsigned> vFanins;
+    std::vector<unsigned> vTable;
+
+    void Insert(unsigned g) {
+      size_t mask = vTable.size() - 1;
+      size_t h = UniqHash(vFanins[2 * g], vFanins[2 * g + 1]) & mask;
+      while(vTable[h])
+        h = (h + 1) & mask;
+      vTable[h] = g + 1;
+    }
+
+  public:
+    AigWriter(unsigned nInputs): nInputs(nInputs), vTable(1024, 0) {}
+    inline unsigned Input(var v)   const { return 2 * (v + 1);                  }
+    inline unsigned NumAnds()      const { return (unsigned)vFanins.size() / 2; }
+    unsigned And(unsigned x, unsigned y) {
+      if(x > y)
+        std::swap(x, y);
+      if(x == 0 || x == (y ^ 1))
+        return 0;
+      if(x == 1 || x == y)
+        return y;
+      size_t mask = vTable.size() - 1;
+      for(size_t h = UniqHash(x, y) & mask; vTable[h]; h = (h + 1) & mask) {
+        unsigned g = vTable[h] - 1;
+        if(vFanins[2 * g] == x && vFanins[2 * g + 1] == y)
+          return 2 * (nInputs + 1 + g);
+      }
+      unsigned g = NumAnds();
+      vFanins.push_back(x);
+      vFanins.push_back(y);
+      if(2 * (size_t)NumAnds() > vTable.size()) {
+        vTable.assign(2 * vTable.size(), 0);
+        for(unsigned k = 0; k < NumAnds(); k++)
+          Insert(k);
+      } else
+        Insert(g);
+      return 2 * (nInputs + 1 + g);
+    }
+    unsigned Or(unsigned x, unsigned y) {
+      return And(x ^ 1, y ^ 1) ^ 1;
+    }
+    unsigned Mux(unsigned c, unsigned t, unsigned e) {
+      if(t == 1)
+        return Or(c, e);
+      if(t == 0)
+        return And(c ^ 1, e);
+      if(e == 0)
+        return And(c, t);
+      if(e == 1)
+        return Or(c ^ 1, t);
+      return Or(And(c, t), And(c ^ 1, e));
+    }
+    void Write(std::string const &name, std::vector<unsigned> const &vOutputs) const {
+      std::ofstream f(name, std::ios::binary);
+      if(!f)
+        throw std::runtime_error("Cannot open " + name);
+      f << "aig " << nInputs + NumAnds() << " " << nInputs << " 0 " << vOutputs.size() << " " << NumAnds() << "\n";
+      for(size_t i = 0; i < vOutputs.size(); i++)
+        f << vOutputs[i] << "\n";
+      std::string buf;
+      auto Encode = [&](unsigned x) {
+        while(x & ~0x7fu) {
+          buf.push_back((char)((x & 0x7f) | 0x80));
+          x >>= 7;
+        }
+        buf.push_back((char)x);
+      };
+      for(unsigned g = 0; g < NumAnds(); g++) {
+        unsigned lhs = 2 * (nInputs + 1 + g);
+        Encode(lhs - vFanins[2 * g + 1]);
+        Encode(vFanins[2 * g + 1] - vFanins[2 * g]);
+      }
+      f.write(buf.data(), buf.size());
+      if(!f)
+        throw std::runtime_error("Cannot write " + name);
+    }
+  };
+
+  // lit of a Bdd handle, linked into its manager
+  struct BddLink {
+    lit      x;
+    BddLink *pPrev;
+    BddLink *pNext;
   };
 
   class Man {
+  private:
+    struct Frame {
+      lit           x;
+      lit           y;
+      lit           z;
+      lit           r1;
+      lit           r0;
+      var           v;
+      unsigned char op;
+      unsigned char state;
+      bool          c;
+      bool          q;
+    };
+
   private:
     var    nVars;
     bvar   nObjs;
@@ -160,32 +948,102 @@ namespace NextBdd {
     bvar   RemovedHead;
     int    nGbc;
     bvar   nReo;
+    size   nReoCheck;
+    size   nAllocs;
+    size   nAllocsLast;
+    int    nReoBackoff;
     double MaxGrowth;
+    double ReoMinGain;
+    double ReoTimeLimit;
+    int    nReoGbcs;
+    int    nGbcsSinceReo;
+    std::chrono::steady_clock::time_point ReoLast;
+    std::chrono::steady_clock::time_point ReoDeadline;
     bool   fReoVerbose;
+    bool   fReoPar;
+    bool   fSiftBound;
+    bool   fSiftCost;
+    int    nReoMethod;
+    int    nReoWindow;
+    double MinGain;
+    bool   fSwapPar;
+    size   nReos;
+    double ReoTime;
+    bvar   nReoBefore;
+    bvar   nReoAfter;
+    std::mutex          mAlloc;
+    int    nTaskDepth;
+    int    nRecDepth;
     int    nVerbose;
-    std::vector<var>    vVars;
+    // free nodes handed out to the threads of the parallel apply
+    struct alignas(64) Batch {
+      bvar Head;
+    };
+    std::vector<Batch>  vBatches;
+    std::atomic<bool>   fAbort;
+    int    nMinorSkips;
+    size   nMinorGbcs;
+    size   nMajorGbcs;
+    size   nGbcFreed;
+    double GbcTime;
+    double GbcMaxPause;
+    Budget *pBudget;
+    bvar   nReadPeakLive;
+    size   nReadPeakHeld;
+#ifdef NEXT_BDD_PACKED
+    // node record; bit 0 of Else holds the mark
+    struct Node {
+      lit  Then;
+      lit  Else;
+      bvar Next;
+      var  Var;
+      ref  Ref;
+    };
+    bool                fRefs;
+    Arena<Node>         vNodes;
+#else
+    Arena<var>          vVars;
+    Arena<lit>          vObjs;
+    Arena<bvar>         vNexts;
+    Arena<size>         vMarks;
+    Arena<ref>          vRefs;
+#endif
     std::vector<var>    Var2Level;
     std::vector<var>    Level2Var;
-    std::vector<lit>    vObjs;
-    std::vector<bvar>   vNexts;
-    std::vector<bool>   vMarks;
-    std::vector<ref>    vRefs;
-    std::vector<edge>   vEdges;
-    std::vector<double> vOneCounts;
+    Arena<edge>         vEdges;
     std::vector<uniq>   vUniqueMasks;
     std::vector<bvar>   vUniqueCounts;
     std::vector<bvar>   vUniqueTholds;
     std::vector<std::vector<bvar> > vvUnique;
+#ifdef NEXT_BDD_OPEN
+    std::vector<std::vector<size> > vvUniqueTags;
+    std::vector<bvar>   vUniqueTombs;
+    std::vector<unsigned char> vUniqueLocks;
+#endif
+    std::vector<lit>    vStack;
+    std::vector<Frame>  vFrames;
+    std::vector<size>   vInteract;
+    std::vector<bvar>   vYoung;
+    std::unordered_map<bvar, size> RefOverflow;
+    BddLink *pBdds;
     Cache *cache;
+    TaskPool *pool;
 
   public:
     inline lit  Bvar2Lit(bvar a)          const { return (lit)a << 1;                                       }
     inline lit  Bvar2Lit(bvar a, bool c)  const { return ((lit)a << 1) ^ (lit)c;                            }
     inline bvar Lit2Bvar(lit x)           const { return (bvar)(x >> 1);                                    }
+#ifdef NEXT_BDD_PACKED
+    inline var  VarOfBvar(bvar a)         const { return vNodes[a].Var;                                     }
+    inline lit  ThenOfBvar(bvar a)        const { return vNodes[a].Then;                                    }
+    inline lit  ElseOfBvar(bvar a)        const { return vNodes[a].Else & ~(lit)1;                          }
+    inline ref  RefOfBvar(bvar a)         const { return vNodes[a].Ref;                                     }
+#else
     inline var  VarOfBvar(bvar a)         const { return vVars[a];                                          }
     inline lit  ThenOfBvar(bvar a)        const { return vObjs[Bvar2Lit(a)];                                }
     inline lit  ElseOfBvar(bvar a)        const { return vObjs[Bvar2Lit(a, true)];                          }
     inline ref  RefOfBvar(bvar a)         const { return vRefs[a];                                          }
+#endif
     inline lit  Const0()                  const { return (lit)0;                                            }
     inline lit  Const1()                  const { return (lit)1;                                            }
     inline bool IsConst0(lit x)           const { return x == Const0();                                     }
@@ -197,92 +1055,340 @@ namespace NextBdd {
     inline lit  LitNotCond(lit x, bool c) const { return x ^ (lit)c;                                        }
     inline bool LitIsCompl(lit x)         const { return x & (lit)1;                                        }
     inline bool LitIsEq(lit x, lit y)     const { return x == y;                                            }
-    inline var  Var(lit x)                const { return vVars[Lit2Bvar(x)];                                }
+    inline var  Var(lit x)                const { return VarOfBvar(Lit2Bvar(x));                            }
     inline var  Level(lit x)              const { return Var2Level[Var(x)];                                 }
-    inline lit  Then(lit x)               const { return LitNotCond(vObjs[LitRegular(x)], LitIsCompl(x));   }
-    inline lit  Else(lit x)               const { return LitNotCond(vObjs[LitIrregular(x)], LitIsCompl(x)); }
-    inline ref  Ref(lit x)                const { return vRefs[Lit2Bvar(x)];                                }
-    inline double OneCount(lit x)         const {
-      if(vOneCounts.empty())
-        throw std::logic_error("fCountOnes was not set");
-      if(LitIsCompl(x))
-        return std::pow(2.0, nVars) - vOneCounts[Lit2Bvar(x)];
-      return vOneCounts[Lit2Bvar(x)];
-    }
+    inline lit  Then(lit x)               const { return LitNotCond(ThenOfBvar(Lit2Bvar(x)), LitIsCompl(x)); }
+    inline lit  Else(lit x)               const { return LitNotCond(ElseOfBvar(Lit2Bvar(x)), LitIsCompl(x)); }
+    inline ref  Ref(lit x)                const { return RefOfBvar(Lit2Bvar(x));                            }
 
   public:
-    inline void IncRef(lit x)              { if(!vRefs.empty() && Ref(x) != RefMax()) vRefs[Lit2Bvar(x)]++; }
-    inline void DecRef(lit x)              { if(!vRefs.empty() && Ref(x) != RefMax()) vRefs[Lit2Bvar(x)]--; }
+    // counts past RefMax go to a side table
+    inline void IncRef(lit x) {
+      if(!HasRefs())
+        return;
+      bvar a = Lit2Bvar(x);
+      if(RefOfBvar(a) == RefMax())
+        RefOverflow[a]++;
+      else if(++RefLink(a) == RefMax())
+        RefOverflow[a] = RefMax();
+    }
+    inline void DecRef(lit x) {
+      if(!HasRefs())
+        return;
+      bvar a = Lit2Bvar(x);
+      if(RefOfBvar(a) != RefMax()) {
+        RefLink(a)--;
+        return;
+      }
+      auto it = RefOverflow.find(a);
+      if(it == RefOverflow.end()) {
+        // saturated exactly, with nothing in the side table yet
+        RefLink(a)--;
+        return;
+      }
+      if(--it->second < RefMax()) {
+        RefLink(a) = (ref)it->second;
+        RefOverflow.erase(it);
+      }
+    }
+    // a handle is linked while it holds its lit
+    inline void LinkBdd(BddLink *p) {
+      p->pPrev = NULL;
+      p->pNext = pBdds;
+      if(pBdds)
+        pBdds->pPrev = p;
+      pBdds = p;
+    }
+    inline void UnlinkBdd(BddLink *p) {
+      if(p->pPrev)
+        p->pPrev->pNext = p->pNext;
+      else
+        pBdds = p->pNext;
+      if(p->pNext)
+        p->pNext->pPrev = p->pPrev;
+    }
 
   private:
-    inline bool Mark(lit x)               const { return vMarks[Lit2Bvar(x)];                               }
-    inline edge Edge(lit x)               const { return vEdges[Lit2Bvar(x)];                               }
-    inline void SetMark(lit x)                  { vMarks[Lit2Bvar(x)] = true;                               }
-    inline void ResetMark(lit x)                { vMarks[Lit2Bvar(x)] = false;                              }
-    inline void IncEdge(lit x)                  { vEdges[Lit2Bvar(x)]++;                                    }
-    inline void DecEdge(lit x)                  { vEdges[Lit2Bvar(x)]--;                                    }
-    inline bool MarkOfBvar(bvar a)        const { return vMarks[a];                                         }
-    inline edge EdgeOfBvar(bvar a)        const { return vEdges[a];                                         }
+#ifdef NEXT_BDD_PACKED
+    inline bool MarkOfBvar(bvar a)        const { return vNodes[a].Else & (lit)1;                           }
+    inline bvar NextOfBvar(bvar a)        const { return vNodes[a].Next;                                    }
+    inline bool HasRefs()                 const { return fRefs;                                             }
+    inline void SetVarOfBvar(bvar a, var v)     { vNodes[a].Var = v;                                        }
+    inline void SetThenOfBvar(bvar a, lit x)    { vNodes[a].Then = x;                                       }
+    inline void SetElseOfBvar(bvar a, lit x)    { vNodes[a].Else = x | (vNodes[a].Else & (lit)1);           }
+    inline void SetMarkOfBvar(bvar a)           { vNodes[a].Else |= (lit)1;                                 }
+    inline void ResetMarkOfBvar(bvar a)         { vNodes[a].Else &= ~(lit)1;                                }
+    // atomic mark
+    inline bool SetMarkOfBvarPar(bvar a)        { return !(__atomic_fetch_or(&vNodes[a].Else, (lit)1, __ATOMIC_RELAXED) & 1); }
+    inline lit  ElseOfBvarPar(bvar a)     const { return __atomic_load_n(&vNodes[a].Else, __ATOMIC_RELAXED) & ~(lit)1; }
+    inline void SetNextOfBvar(bvar a, bvar b)   { vNodes[a].Next = b;                                       }
+    inline bvar *NextLink(bvar a)               { return &vNodes[a].Next;                                   }
+    inline var  &VarLink(bvar a)                { return vNodes[a].Var;                                     }
+    inline var const &VarLink(bvar a)     const { return vNodes[a].Var;                                     }
+    inline ref  &RefLink(bvar a)                { return vNodes[a].Ref;                                     }
+#else
+    inline bool MarkOfBvar(bvar a)        const { return (vMarks[a >> 6] >> (a & 63)) & 1;                  }
+    inline bvar NextOfBvar(bvar a)        const { return vNexts[a];                                         }
+    inline bool HasRefs()                 const { return !vRefs.empty();                                    }
     inline void SetVarOfBvar(bvar a, var v)     { vVars[a] = v;                                             }
     inline void SetThenOfBvar(bvar a, lit x)    { vObjs[Bvar2Lit(a)] = x;                                   }
     inline void SetElseOfBvar(bvar a, lit x)    { vObjs[Bvar2Lit(a, true)] = x;                             }
-    inline void SetMarkOfBvar(bvar a)           { vMarks[a] = true;                                         }
-    inline void ResetMarkOfBvar(bvar a)         { vMarks[a] = false;                                        }
+    inline void SetMarkOfBvar(bvar a)           { vMarks[a >> 6] |= (size)1 << (a & 63);                    }
+    inline void ResetMarkOfBvar(bvar a)         { vMarks[a >> 6] &= ~((size)1 << (a & 63));                 }
+    // atomic mark
+    inline bool SetMarkOfBvarPar(bvar a)        { size b = (size)1 << (a & 63); return !(__atomic_fetch_or(&vMarks[a >> 6], b, __ATOMIC_RELAXED) & b); }
+    inline lit  ElseOfBvarPar(bvar a)     const { return vObjs[Bvar2Lit(a, true)];                          }
+    inline void SetNextOfBvar(bvar a, bvar b)   { vNexts[a] = b;                                            }
+    inline bvar *NextLink(bvar a)               { return &vNexts[a];                                        }
+    inline var  &VarLink(bvar a)                { return vVars[a];                                          }
+    inline var const &VarLink(bvar a)     const { return vVars[a];                                          }
+    inline ref  &RefLink(bvar a)                { return vRefs[a];                                          }
+#endif
+    // read during parallel sifting
+    inline var  VarPar(lit x)             const { return __atomic_load_n(&VarLink(Lit2Bvar(x)), __ATOMIC_RELAXED); }
+    inline void SetVarOfBvarPar(bvar a, var v)  { __atomic_store_n(&VarLink(a), v, __ATOMIC_RELAXED);        }
+    inline bool Mark(lit x)               const { return MarkOfBvar(Lit2Bvar(x));                           }
+    inline edge Edge(lit x)               const { return __atomic_load_n(&vEdges[Lit2Bvar(x)], __ATOMIC_RELAXED); }
+    inline void SetMark(lit x)                  { SetMarkOfBvar(Lit2Bvar(x));                               }
+    inline void ResetMark(lit x)                { ResetMarkOfBvar(Lit2Bvar(x));                             }
+    inline void IncEdge(lit x) {
+      if(fSwapPar)
+        __atomic_fetch_add(&vEdges[Lit2Bvar(x)], 1, __ATOMIC_RELAXED);
+      else
+        vEdges[Lit2Bvar(x)]++;
+    }
+    inline edge DecEdge(lit x) {
+      if(fSwapPar)
+        return __atomic_sub_fetch(&vEdges[Lit2Bvar(x)], 1, __ATOMIC_RELAXED);
+      return --vEdges[Lit2Bvar(x)];
+    }
+    inline edge EdgeOfBvar(bvar a)        const { return __atomic_load_n(&vEdges[a], __ATOMIC_RELAXED);     }
+    // reserve address space for nObjsMax nodes
+    void ReserveNodes(int nHugePage) {
+#ifdef NEXT_BDD_PACKED
+      vNodes.Reserve(nObjsMax, nHugePage);
+#else
+      vVars.Reserve(nObjsMax, nHugePage);
+      vObjs.Reserve((size_t)nObjsMax * 2, nHugePage);
+      vNexts.Reserve(nObjsMax, nHugePage);
+      vMarks.Reserve(((size_t)nObjsMax + 63) >> 6, nHugePage);
+      vRefs.Reserve(nObjsMax, nHugePage);
+#endif
+      vEdges.Reserve(nObjsMax, nHugePage);
+    }
+    // allocate node storage for nObjsAlloc nodes
+    void ResizeNodes() {
+#ifdef NEXT_BDD_PACKED
+      vNodes.resize(nObjsAlloc);
+#else
+      vVars.resize(nObjsAlloc);
+      vObjs.resize((lit)nObjsAlloc * 2);
+      vNexts.resize(nObjsAlloc);
+      vMarks.resize(((size_t)nObjsAlloc + 63) >> 6);
+      if(!vRefs.empty())
+        vRefs.resize(nObjsAlloc);
+#endif
+    }
+    // give back the storage beyond nObjsAlloc nodes
+    void TrimNodes() {
+      ResizeNodes();
+#ifdef NEXT_BDD_PACKED
+      vNodes.shrink_to_fit();
+#else
+      vVars.shrink_to_fit();
+      vObjs.shrink_to_fit();
+      vNexts.shrink_to_fit();
+      vMarks.shrink_to_fit();
+      vRefs.shrink_to_fit();
+#endif
+    }
+    // enable reference counting with all counts cleared
+    void ClearRefs() {
+#ifdef NEXT_BDD_PACKED
+      for(bvar a = 0; a < nObjsAlloc; a++)
+        vNodes[a].Ref = 0;
+      fRefs = true;
+#else
+      vRefs.clear();
+      vRefs.resize(nObjsAlloc);
+#endif
+      RefOverflow.clear();
+    }
+#ifdef NEXT_BDD_OPEN
+    // open tables: groups of 8 slots with a word of tags
+    static inline unsigned char UniqTag(size h)  { return (unsigned char)(2 + (h >> 56) % 254); }
+    static inline size TagBytes(unsigned char t) { return (size)t * 0x0101010101010101ull;      }
+    // 0x80 in each byte of w that is zero
+    static inline size ZeroBytes(size w) {
+      size lo = 0x7F7F7F7F7F7F7F7Full;
+      return ~(((w & lo) + lo) | w | lo);
+    }
+    inline unsigned char TagOfSlot(var v, size_t j) const {
+      return (unsigned char)(vvUniqueTags[v][j >> 3] >> ((j & 7) << 3));
+    }
+    inline void SetTagOfSlot(var v, size_t j, unsigned char t) {
+      size &w = vvUniqueTags[v][j >> 3];
+      int k = (j & 7) << 3;
+      w = (w & ~((size)0xFF << k)) | (size)t << k;
+    }
+    // slot of (x1, x0) in v, or the first free one
+    inline size_t UniqueProbe(var v, lit x1, lit x0, bool &fFound) const {
+      size h = UniqHashOpen(x1, x0);
+      size t = TagBytes(UniqTag(h));
+      size_t g = (size_t)(h >> 32) & vUniqueMasks[v];
+      size_t j = (size_t)-1;
+      for(size_t i = 1; ; i++) {
+        size w = vvUniqueTags[v][g];
+        for(size m = ZeroBytes(w ^ t); m; m &= m - 1) {
+          size_t k = g * 8 + (__builtin_ctzll(m) >> 3);
+          bvar a = vvUnique[v][k];
+          if(ThenOfBvar(a) == x1 && ElseOfBvar(a) == x0) {
+            fFound = true;
+            return k;
+          }
+        }
+        size e = ZeroBytes(w);
+        if(j == (size_t)-1) {
+          size m = e | ZeroBytes(w ^ TagBytes(1));
+          if(m)
+            j = g * 8 + (__builtin_ctzll(m) >> 3);
+        }
+        if(e)
+          break;
+        g = (g + i) & vUniqueMasks[v];
+      }
+      fFound = false;
+      return j;
+    }
+    // the fields of a are already set
+    inline void UniqueInsertSlot(var v, size_t j, bvar a) {
+      if(TagOfSlot(v, j) == 1)
+        vUniqueTombs[v]--;
+      vvUnique[v][j] = a;
+      SetTagOfSlot(v, j, UniqTag(UniqHashOpen(ThenOfBvar(a), ElseOfBvar(a))));
+      vUniqueCounts[v]++;
+    }
+    inline void UniqueEraseSlot(var v, size_t j) {
+      SetTagOfSlot(v, j, 1);
+      vUniqueTombs[v]++;
+      vUniqueCounts[v]--;
+    }
+#endif
+    // deleted slots of an open table count towards its load
+    inline bool UniqueFull(var v) const {
+#ifdef NEXT_BDD_OPEN
+      return vUniqueCounts[v] + vUniqueTombs[v] > vUniqueTholds[v];
+#else
+      return vUniqueCounts[v] > vUniqueTholds[v];
+#endif
+    }
+    // visit the table of v
+    template <typename F>
+    bool ForEachUnique(var v, F f) {
+#ifdef NEXT_BDD_OPEN
+      for(size_t j = 0; j < vvUnique[v].size(); j++)
+        if(TagOfSlot(v, j) >= 2 && !f(vvUnique[v][j]))
+          return false;
+#else
+      for(bvar entry: vvUnique[v])
+        for(bvar a = entry; a; a = NextOfBvar(a))
+          if(!f(a))
+            return false;
+#endif
+      return true;
+    }
     inline void RemoveBvar(bvar a) {
       var v = VarOfBvar(a);
+#ifdef NEXT_BDD_OPEN
+      bool fFound;
+      UniqueEraseSlot(v, UniqueProbe(v, ThenOfBvar(a), ElseOfBvar(a), fFound));
       SetVarOfBvar(a, VarMax());
-      std::vector<bvar>::iterator q = vvUnique[v].begin() + (UniqHash(ThenOfBvar(a), ElseOfBvar(a)) & vUniqueMasks[v]);
-      for(; *q; q = vNexts.begin() + *q)
+      SetNextOfBvar(a, RemovedHead);
+      RemovedHead = a;
+#else
+      SetVarOfBvar(a, VarMax());
+      bvar *q = &vvUnique[v][UniqHash(ThenOfBvar(a), ElseOfBvar(a)) & vUniqueMasks[v]];
+      for(; *q; q = NextLink(*q))
         if(*q == a)
           break;
-      bvar next = vNexts[*q];
-      vNexts[*q] = RemovedHead;
+      bvar next = NextOfBvar(*q);
+      SetNextOfBvar(*q, RemovedHead);
       RemovedHead = *q;
       *q = next;
       vUniqueCounts[v]--;
+#endif
     }
 
   private:
-    void SetMark_rec(lit x) {
-      if(x < 2 || Mark(x))
-        return;
-      SetMark(x);
-      SetMark_rec(Then(x));
-      SetMark_rec(Else(x));
+    // iterative traversals
+    void SetMark_iter(lit x) {
+      vStack.push_back(x);
+      while(!vStack.empty()) {
+        x = vStack.back();
+        vStack.pop_back();
+        while(x >= 2 && !Mark(x)) {
+          SetMark(x);
+          if(Else(x) >= 2 && !Mark(Else(x)))
+            vStack.push_back(Else(x));
+          x = Then(x);
+        }
+      }
     }
-    void ResetMark_rec(lit x) {
-      if(x < 2 || !Mark(x))
-        return;
-      ResetMark(x);
-      ResetMark_rec(Then(x));
-      ResetMark_rec(Else(x));
+    void ResetMark_iter(lit x) {
+      vStack.push_back(x);
+      while(!vStack.empty()) {
+        x = vStack.back();
+        vStack.pop_back();
+        while(x >= 2 && Mark(x)) {
+          ResetMark(x);
+          if(Else(x) >= 2 && Mark(Else(x)))
+            vStack.push_back(Else(x));
+          x = Then(x);
+        }
+      }
     }
-    bvar CountNodes_rec(lit x) {
-      if(x < 2 || Mark(x))
-        return 0;
-      SetMark(x);
-      return 1 + CountNodes_rec(Then(x)) + CountNodes_rec(Else(x));
+    bvar CountNodes_iter(lit x) {
+      bvar count = 0;
+      vStack.push_back(x);
+      while(!vStack.empty()) {
+        x = vStack.back();
+        vStack.pop_back();
+        while(x >= 2 && !Mark(x)) {
+          SetMark(x);
+          count++;
+          if(Else(x) >= 2 && !Mark(Else(x)))
+            vStack.push_back(Else(x));
+          x = Then(x);
+        }
+      }
+      return count;
     }
-    void CountEdges_rec(lit x) {
-      if(x < 2)
-        return;
-      IncEdge(x);
-      if(Mark(x))
-        return;
-      SetMark(x);
-      CountEdges_rec(Then(x));
-      CountEdges_rec(Else(x));
+    void CountEdges_iter(lit x) {
+      vStack.push_back(x);
+      while(!vStack.empty()) {
+        x = vStack.back();
+        vStack.pop_back();
+        while(x >= 2) {
+          IncEdge(x);
+          if(Mark(x))
+            break;
+          SetMark(x);
+          if(Else(x) >= 2)
+            vStack.push_back(Else(x));
+          x = Then(x);
+        }
+      }
     }
     void CountEdges() {
       vEdges.resize(nObjsAlloc);
       for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
         if(RefOfBvar(a))
-          CountEdges_rec(Bvar2Lit(a));
+          CountEdges_iter(Bvar2Lit(a));
       for(bvar a = 1; a <= (bvar)nVars; a++)
         vEdges[a]++;
       for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
         if(RefOfBvar(a))
-          ResetMark_rec(Bvar2Lit(a));
+          ResetMark_iter(Bvar2Lit(a));
     }
 
   public:
@@ -290,25 +1396,40 @@ namespace NextBdd {
       if(nObjsAlloc == nObjsMax)
         return false;
       lit nObjsAllocLit = (lit)nObjsAlloc << 1;
-      if(nObjsAllocLit > (lit)BvarMax())
-        nObjsAlloc = BvarMax();
-      else
-        nObjsAlloc = (bvar)nObjsAllocLit;
+      bvar nObjsAllocNew = nObjsAllocLit > (lit)BvarMax()? BvarMax(): (bvar)nObjsAllocLit;
+      if(pBudget && !pBudget->BorrowNodes(nObjsAllocNew - nObjsAlloc))
+        return false;
+      nObjsAlloc = nObjsAllocNew;
       if(nVerbose >= 2)
         std::cout << "Reallocating " << nObjsAlloc << " nodes" << std::endl;
-      vVars.resize(nObjsAlloc);
-      vObjs.resize((lit)nObjsAlloc * 2);
-      vNexts.resize(nObjsAlloc);
-      vMarks.resize(nObjsAlloc);
-      if(!vRefs.empty())
-        vRefs.resize(nObjsAlloc);
+      ResizeNodes();
       if(!vEdges.empty())
         vEdges.resize(nObjsAlloc);
-      if(!vOneCounts.empty())
-        vOneCounts.resize(nObjsAlloc);
       return true;
     }
     void ResizeUnique(var v) {
+#ifdef NEXT_BDD_OPEN
+      // double when over 7/16 live, otherwise drop deleted slots
+      size_t nSlots = vvUnique[v].size();
+      std::vector<bvar> vLive;
+      vLive.reserve(vUniqueCounts[v]);
+      for(size_t j = 0; j < nSlots; j++)
+        if(TagOfSlot(v, j) >= 2)
+          vLive.push_back(vvUnique[v][j]);
+      if((size)vUniqueCounts[v] * 16 > (size)nSlots * 7)
+        nSlots <<= 1;
+      if(nVerbose >= 2)
+        std::cout << "Reallocating " << nSlots << " unique table entries for Var " << v << std::endl;
+      vvUnique[v].assign(nSlots, 0);
+      vvUniqueTags[v].assign(nSlots >> 3, 0);
+      vUniqueMasks[v] = (uniq)(nSlots >> 3) - 1;
+      vUniqueCounts[v] = vUniqueTombs[v] = 0;
+      for(bvar a: vLive) {
+        bool fFound;
+        UniqueInsertSlot(v, UniqueProbe(v, ThenOfBvar(a), ElseOfBvar(a), fFound), a);
+      }
+      vUniqueTholds[v] = (size)(nSlots >> 3) * 7 > (size)BvarMax()? BvarMax(): (bvar)((nSlots >> 3) * 7);
+#else
       uniq nUniqueSize, nUniqueSizeOld;
       nUniqueSize = nUniqueSizeOld = vvUnique[v].size();
       nUniqueSize <<= 1;
@@ -321,8 +1442,8 @@ namespace NextBdd {
       vvUnique[v].resize(nUniqueSize);
       vUniqueMasks[v] = nUniqueSize - 1;
       for(uniq i = 0; i < nUniqueSizeOld; i++) {
-        std::vector<bvar>::iterator q, tail, tail1, tail2;
-        q = tail1 = vvUnique[v].begin() + i;
+        bvar *q, *tail, *tail1, *tail2;
+        q = tail1 = &vvUnique[v][i];
         tail2 = q + nUniqueSizeOld;
         while(*q) {
           uniq hash = UniqHash(ThenOfBvar(*q), ElseOfBvar(*q)) & vUniqueMasks[v];
@@ -332,7 +1453,7 @@ namespace NextBdd {
             tail = tail2;
           if(tail != q)
             *tail = *q, *q = 0;
-          q = vNexts.begin() + *tail;
+          q = NextLink(*tail);
           if(tail == tail1)
             tail1 = q;
           else
@@ -342,65 +1463,363 @@ namespace NextBdd {
       vUniqueTholds[v] <<= 1;
       if((lit)vUniqueTholds[v] > (lit)BvarMax())
         vUniqueTholds[v] = BvarMax();
+#endif
     }
-    bool Gbc() {
-      if(nVerbose >= 2)
-        std::cout << "Garbage collect" << std::endl;
+    // collect the young generation
+    bvar MinorGbc() {
+      for(bvar a: vYoung)
+        if(VarOfBvar(a) != VarMax())
+          SetMarkOfBvar(a);
+      for(bvar a: vYoung)
+        if(MarkOfBvar(a) && RefOfBvar(a))
+          ResetMark_iter(Bvar2Lit(a));
+      bvar nFreed = 0;
+      for(bvar a: vYoung)
+        if(MarkOfBvar(a)) {
+          ResetMarkOfBvar(a);
+          RemoveBvar(a);
+          nFreed++;
+        }
+      vYoung.clear();
+      return nFreed;
+    }
+    bvar MajorGbc() {
+      bvar nFreed = 0;
       if(!vEdges.empty()) {
         for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
           if(!EdgeOfBvar(a) && VarOfBvar(a) != VarMax())
-            RemoveBvar(a);
-      } else {
+            RemoveBvar(a), nFreed++;
+      } else if(pool)
+        nFreed = MajorGbcPar();
+      else {
         for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
           if(RefOfBvar(a))
-            SetMark_rec(Bvar2Lit(a));
+            SetMark_iter(Bvar2Lit(a));
         for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
           if(!MarkOfBvar(a) && VarOfBvar(a) != VarMax())
-            RemoveBvar(a);
+            RemoveBvar(a), nFreed++;
         for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
           if(RefOfBvar(a))
-            ResetMark_rec(Bvar2Lit(a));
+            ResetMark_iter(Bvar2Lit(a));
       }
-      cache->Clear();
-      return RemovedHead;
+      vYoung.clear();
+      return nFreed;
     }
-
-  private:
-    inline lit UniqueCreateInt(var v, lit x1, lit x0) {
-      std::vector<bvar>::iterator p, q;
-      p = q = vvUnique[v].begin() + (UniqHash(x1, x0) & vUniqueMasks[v]);
-      for(; *q; q = vNexts.begin() + *q)
-        if(VarOfBvar(*q) == v && ThenOfBvar(*q) == x1 && ElseOfBvar(*q) == x0)
-          return Bvar2Lit(*q);
-      bvar next = *p;
-      if(nObjs < nObjsAlloc)
-        *p = nObjs++;
-      else if(RemovedHead)
-        *p = RemovedHead, RemovedHead = vNexts[*p];
-      else
-        return LitMax();
-      SetVarOfBvar(*p, v);
-      SetThenOfBvar(*p, x1);
-      SetElseOfBvar(*p, x0);
-      vNexts[*p] = next;
-      if(!vOneCounts.empty())
-        vOneCounts[*p] = OneCount(x1) / 2 + OneCount(x0) / 2;
+    // parallel collection
+    bvar MajorGbcPar() {
+      size_t nChunks = 4 * (size_t)pool->Size();
+      size_t nChunk = ((size_t)nObjs / nChunks + 64) & ~(size_t)63;
+      pool->For(nChunks, [&](size_t i) {
+        std::vector<lit> vStack_;
+        size_t e = std::min((size_t)nObjs, (i + 1) * nChunk);
+        for(size_t a = std::max((size_t)nVars + 1, i * nChunk); a < e; a++) {
+          if(!RefOfBvar(a))
+            continue;
+          vStack_.push_back(Bvar2Lit(a));
+          while(!vStack_.empty()) {
+            bvar b = Lit2Bvar(vStack_.back());
+            vStack_.pop_back();
+            while(b > 0 && SetMarkOfBvarPar(b)) {
+              if(ElseOfBvarPar(b) >= 2)
+                vStack_.push_back(ElseOfBvarPar(b));
+              b = Lit2Bvar(ThenOfBvar(b));
+            }
+          }
+        }
+      });
+      std::vector<bvar> vHeads(nVars), vTails(nVars), vCounts(nVars);
+      pool->For(nVars, [&](size_t v) {
+        bvar head = 0, tail = 0, count = 0;
+#ifdef NEXT_BDD_OPEN
+        for(size_t j = 0; j < vvUnique[v].size(); j++) {
+          if(TagOfSlot(v, j) < 2)
+            continue;
+          bvar a = vvUnique[v][j];
+          if(a <= (bvar)nVars || MarkOfBvar(a))
+            continue;
+          SetTagOfSlot(v, j, 1);
+          vUniqueTombs[v]++;
+          SetVarOfBvar(a, VarMax());
+          SetNextOfBvar(a, head);
+          if(!head)
+            tail = a;
+          head = a;
+          count++;
+        }
+#else
+        for(bvar &entry: vvUnique[v]) {
+          bvar *q = &entry;
+          while(*q) {
+            bvar a = *q;
+            if(a <= (bvar)nVars || MarkOfBvar(a)) {
+              q = NextLink(a);
+              continue;
+            }
+            *q = NextOfBvar(a);
+            SetVarOfBvar(a, VarMax());
+            SetNextOfBvar(a, head);
+            if(!head)
+              tail = a;
+            head = a;
+            count++;
+          }
+        }
+#endif
+        vHeads[v] = head, vTails[v] = tail, vCounts[v] = count;
+      });
+      bvar nFreed = 0;
+      for(var v = 0; v < nVars; v++) {
+        if(!vHeads[v])
+          continue;
+        SetNextOfBvar(vTails[v], RemovedHead);
+        RemovedHead = vHeads[v];
+        vUniqueCounts[v] -= vCounts[v];
+        nFreed += vCounts[v];
+      }
+      pool->For(nChunks, [&](size_t i) {
+        size_t e = std::min((size_t)nObjs, (i + 1) * nChunk);
+        for(size_t a = i * nChunk; a < e; a++)
+          ResetMarkOfBvar(a);
+      });
+      return nFreed;
+    }
+    // young collection first, full one when it frees too little
+    bool Gbc() {
+      auto t0 = std::chrono::steady_clock::now();
+      bvar nFreed = 0;
+      if(vEdges.empty() && !vYoung.empty() && !nMinorSkips) {
+        nFreed = MinorGbc();
+        nMinorGbcs++;
+        if(nFreed < nObjsAlloc / 16)
+          nMinorSkips = 4;
+      } else if(nMinorSkips)
+        nMinorSkips--;
+      if(nFreed < nObjsAlloc / 16) {
+        nFreed += MajorGbc();
+        nMajorGbcs++;
+      }
+      cache->Invalidate([&](lit x) { return x >= 2 && VarOfBvar(Lit2Bvar(x)) == VarMax(); });
+      double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      nGbcFreed += nFreed;
+      GbcTime += t;
+      GbcMaxPause = std::max(GbcMaxPause, t);
+      nGbcsSinceReo++;
+      if(nReo != BvarMax())
+        nReoCheck = 0;
+      if(nVerbose >= 2)
+        std::cout << "Garbage collect: freed " << nFreed << " nodes in " << t << " s" << std::endl;
+      return RemovedHead;
+    }
+    // renumber the nodes of vLits and handles into a dense prefix
+    bvar Compact(std::vector<lit> &vLits, bool fDfs = true) {
+      auto t0 = std::chrono::steady_clock::now();
+      if(HasRefs()) {
+        std::vector<size> vHeld(nObjs);
+        for(BddLink *p = pBdds; p; p = p->pNext)
+          vHeld[Lit2Bvar(p->x)]++;
+        for(size_t i = 0; i < vLits.size(); i++)
+          vHeld[Lit2Bvar(vLits[i])] = SizeMax();
+        for(bvar a = (bvar)nVars + 1; a < nObjs; a++) {
+          if(!RefOfBvar(a) || VarOfBvar(a) == VarMax())
+            continue;
+          auto it = RefOverflow.find(a);
+          if((it == RefOverflow.end()? (size)RefOfBvar(a): it->second) > vHeld[a])
+            throw std::invalid_argument("Referenced node outside vLits in Compact");
+        }
+      }
+      // new index of each old node; variable nodes stay in place
+      std::vector<bvar> vMap(nObjs);
+      for(bvar a = 0; a <= (bvar)nVars; a++)
+        vMap[a] = a;
+      std::vector<bvar> vOrder;
+      bvar nNew = (bvar)nVars + 1;
+      auto Done = [&](lit x) { return Lit2Bvar(x) <= (bvar)nVars || vMap[Lit2Bvar(x)]; };
+      auto Visit = [&](lit x) {
+        if(Done(x))
+          return;
+        vStack.push_back(x);
+        while(!vStack.empty()) {
+          bvar a = Lit2Bvar(vStack.back());
+          if(vMap[a]) {
+            vStack.pop_back();
+            continue;
+          }
+          if(!Done(ThenOfBvar(a))) {
+            vStack.push_back(ThenOfBvar(a));
+            continue;
+          }
+          if(!Done(ElseOfBvar(a))) {
+            vStack.push_back(ElseOfBvar(a));
+            continue;
+          }
+          vMap[a] = nNew++;
+          vOrder.push_back(a);
+          vStack.pop_back();
+        }
+      };
+      for(BddLink *p = pBdds; p; p = p->pNext)
+        Visit(p->x);
+      for(size_t i = 0; i < vLits.size(); i++)
+        Visit(vLits[i]);
+      if(!fDfs) {
+        // stable bucket sort by level, bottom level first
+        std::vector<bvar> vStarts(nVars + 1);
+        for(bvar a: vOrder)
+          vStarts[nVars - Var2Level[VarOfBvar(a)]]++;
+        bvar n = 0;
+        for(var i = 0; i <= nVars; i++)
+          std::swap(vStarts[i], n), n += vStarts[i];
+        std::vector<bvar> vOrder2(vOrder.size());
+        for(bvar a: vOrder) {
+          bvar i = vStarts[nVars - Var2Level[VarOfBvar(a)]]++;
+          vOrder2[i] = a;
+          vMap[a] = (bvar)nVars + 1 + i;
+        }
+        vOrder.swap(vOrder2);
+      }
+      // copy the live nodes out
+      std::vector<var> vVars_(vOrder.size());
+      std::vector<lit> vObjs_(2 * vOrder.size());
+      std::vector<ref> vRefs_(HasRefs()? vOrder.size(): 0);
+      auto Remap = [&](lit x) { return Bvar2Lit(vMap[Lit2Bvar(x)], LitIsCompl(x)); };
+      for(size_t i = 0; i < vOrder.size(); i++) {
+        bvar a = vOrder[i];
+        vVars_[i] = VarOfBvar(a);
+        vObjs_[2 * i] = Remap(ThenOfBvar(a));
+        vObjs_[2 * i + 1] = Remap(ElseOfBvar(a));
+        if(HasRefs())
+          vRefs_[i] = RefOfBvar(a);
+      }
+      for(size_t i = 0; i < vOrder.size(); i++) {
+        bvar a = (bvar)nVars + 1 + (bvar)i;
+        SetVarOfBvar(a, vVars_[i]);
+        SetThenOfBvar(a, vObjs_[2 * i]);
+        SetElseOfBvar(a, vObjs_[2 * i + 1]);
+        if(HasRefs())
+          RefLink(a) = vRefs_[i];
+      }
+      // new nodes expect a cleared count
+      for(bvar a = nNew; a < nObjs; a++) {
+        SetVarOfBvar(a, VarMax());
+        if(HasRefs())
+          RefLink(a) = 0;
+      }
+      nObjs = nNew;
+      for(size_t i = 0; i < vLits.size(); i++)
+        vLits[i] = Remap(vLits[i]);
+      for(BddLink *p = pBdds; p; p = p->pNext)
+        p->x = Remap(p->x);
+      std::unordered_map<bvar, size> RefOverflow_;
+      for(auto const &entry: RefOverflow)
+        RefOverflow_[vMap[entry.first]] = entry.second;
+      RefOverflow.swap(RefOverflow_);
+      // rebuild the unique tables
+      for(var v = 0; v < nVars; v++) {
+        std::fill(vvUnique[v].begin(), vvUnique[v].end(), 0);
+#ifdef NEXT_BDD_OPEN
+        std::fill(vvUniqueTags[v].begin(), vvUniqueTags[v].end(), 0);
+        vUniqueTombs[v] = 0;
+#endif
+        vUniqueCounts[v] = 0;
+      }
+      for(bvar a = 1; a < nObjs; a++) {
+        var v = VarOfBvar(a);
+#ifdef NEXT_BDD_OPEN
+        bool fFound;
+        UniqueInsertSlot(v, UniqueProbe(v, ThenOfBvar(a), ElseOfBvar(a), fFound), a);
+#else
+        bvar *q = &vvUnique[v][UniqHash(ThenOfBvar(a), ElseOfBvar(a)) & vUniqueMasks[v]];
+        SetNextOfBvar(a, *q);
+        *q = a;
+        vUniqueCounts[v]++;
+#endif
+      }
+      RemovedHead = 0;
+      vYoung.clear();
+      cache->Clear();
+      // trim the storage
+      bvar nObjsAllocOld = nObjsAlloc;
+      while(nObjs <= nObjsAlloc / 4)
+        nObjsAlloc /= 2;
+      if(nObjsAlloc != nObjsAllocOld) {
+        TrimNodes();
+        if(pBudget)
+          pBudget->ReturnNodes(nObjsAllocOld - nObjsAlloc);
+      }
+      double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      if(nVerbose >= 2)
+        std::cout << "Compact: " << nObjs << " nodes, " << nObjsAlloc << " allocated in " << t << " s" << std::endl;
+      return nObjs;
+    }
+
+  private:
+    // locked for parallel sifting
+    inline bvar NewBvarInt() {
+      bvar a = 0;
+      if(nObjs < nObjsAlloc)
+        a = nObjs++;
+      else if(RemovedHead)
+        a = RemovedHead, RemovedHead = NextOfBvar(a);
+      if(a)
+        nAllocs++;
+      return a;
+    }
+    inline bvar NewBvar() {
+      if(!fSwapPar)
+        return NewBvarInt();
+      std::lock_guard<std::mutex> l(mAlloc);
+      return NewBvarInt();
+    }
+    inline void FreeBvar(bvar a) {
+      std::unique_lock<std::mutex> l(mAlloc, std::defer_lock);
+      if(fSwapPar)
+        l.lock();
+      SetNextOfBvar(a, RemovedHead);
+      RemovedHead = a;
+    }
+    inline lit UniqueCreateInt(var v, lit x1, lit x0) {
+#ifdef NEXT_BDD_OPEN
+      bool fFound;
+      size_t j = UniqueProbe(v, x1, x0, fFound);
+      if(fFound)
+        return Bvar2Lit(vvUnique[v][j]);
+      bvar a = NewBvar();
+      if(!a)
+        return LitMax();
+      SetVarOfBvar(a, v);
+      SetThenOfBvar(a, x1);
+      SetElseOfBvar(a, x0);
+      UniqueInsertSlot(v, j, a);
+#else
+      bvar *p, *q;
+      p = q = &vvUnique[v][UniqHash(x1, x0) & vUniqueMasks[v]];
+      for(; *q; q = NextLink(*q))
+        if(VarOfBvar(*q) == v && ThenOfBvar(*q) == x1 && ElseOfBvar(*q) == x0)
+          return Bvar2Lit(*q);
+      bvar next = *p;
+      *p = NewBvar();
+      if(!*p) {
+        *p = next;
+        return LitMax();
+      }
+      bvar a = *p;
+      SetVarOfBvar(a, v);
+      SetThenOfBvar(a, x1);
+      SetElseOfBvar(a, x0);
+      SetNextOfBvar(a, next);
+      vUniqueCounts[v]++;
+#endif
+      if(nGbc)
+        vYoung.push_back(a);
       if(nVerbose >= 3) {
-        std::cout << "Create node " << std::setw(10) << *p << ": "
+        std::cout << "Create node " << std::setw(10) << a << ": "
                   << "Var = " << std::setw(6) << v << ", "
                   << "Then = " << std::setw(10) << x1 << ", "
-                  << "Else = " << std::setw(10) << x0;
-        if(!vOneCounts.empty())
-          std::cout << ", Ones = " << std::setw(10) << vOneCounts[*q];
-        std::cout << std::endl;
+                  << "Else = " << std::setw(10) << x0 << std::endl;
       }
-      vUniqueCounts[v]++;
-      if(vUniqueCounts[v] > vUniqueTholds[v]) {
-        bvar a = *p;
+      if(UniqueFull(v))
         ResizeUnique(v);
-        return Bvar2Lit(a);
-      }
-      return Bvar2Lit(*p);
+      return Bvar2Lit(a);
     }
     inline lit UniqueCreate(var v, lit x1, lit x0) {
       if(x1 == x0)
@@ -412,6 +1831,12 @@ namespace NextBdd {
         else
           x = UniqueCreateInt(v, LitNot(x1), LitNot(x0));
         if(x == LitMax()) {
+          std::unique_lock<std::mutex> l(mAlloc, std::defer_lock);
+          if(fSwapPar) {
+            l.lock();
+            if(nObjs < nObjsAlloc || RemovedHead)
+              continue;
+          }
           bool fRemoved = false;
           if(nGbc > 1)
             fRemoved = Gbc();
@@ -422,16 +1847,258 @@ namespace NextBdd {
       }
       return LitIsCompl(x0)? LitNot(x): x;
     }
-    lit And_rec(lit x, lit y) {
+    // cube of positive literals
+    inline lit SkipCube(lit cube, var lev) const {
+      while(cube != 1 && Level(cube) < lev)
+        cube = Then(cube);
+      return cube;
+    }
+    inline lit Cofactor(lit x, var v, bool c) const {
+      if(x < 2 || Var(x) != v)
+        return x;
+      return c? Then(x): Else(x);
+    }
+    // normalize a frame; true if no expansion is needed
+    template <bool fPar>
+    inline bool ApplyEnter(Frame &f, lit &r) {
+      while(true) {
+        lit x = f.x, y = f.y, z = f.z;
+        switch(f.op) {
+        case OpAnd:
+          if(x == 0 || y == 1) {
+            r = LitNotCond(x, f.c);
+            return true;
+          }
+          if(x == 1 || y == 0) {
+            r = LitNotCond(y, f.c);
+            return true;
+          }
+          if(Lit2Bvar(x) == Lit2Bvar(y)) {
+            r = LitNotCond((x == y)? x: 0, f.c);
+            return true;
+          }
+          if(x > y)
+            std::swap(x, y);
+          break;
+        case OpXor:
+          if(x < 2) {
+            r = LitNotCond(y, f.c ^ x);
+            return true;
+          }
+          if(y < 2) {
+            r = LitNotCond(x, f.c ^ y);
+            return true;
+          }
+          if(Lit2Bvar(x) == Lit2Bvar(y)) {
+            r = LitNotCond((x == y)? 0: 1, f.c);
+            return true;
+          }
+          // cache regular pairs only
+          f.c ^= LitIsCompl(x) ^ LitIsCompl(y);
+          x = LitRegular(x);
+          y = LitRegular(y);
+          if(x > y)
+            std::swap(x, y);
+          break;
+        case OpIte:
+          if(x < 2) {
+            r = LitNotCond(x? y: z, f.c);
+            return true;
+          }
+          if(Lit2Bvar(y) == Lit2Bvar(x))
+            y = (y == x)? 1: 0;
+          if(Lit2Bvar(z) == Lit2Bvar(x))
+            z = (z == x)? 0: 1;
+          if(y == z) {
+            r = LitNotCond(y, f.c);
+            return true;
+          }
+          if(y < 2 || z < 2 || y == LitNot(z)) {
+            if(y == 1)
+              f.op = OpAnd, f.x = LitNot(x), f.y = LitNot(z), f.c ^= 1;
+            else if(y == 0)
+              f.op = OpAnd, f.x = LitNot(x), f.y = z;
+            else if(z == 0)
+              f.op = OpAnd, f.x = x, f.y = y;
+            else if(z == 1)
+              f.op = OpAnd, f.x = x, f.y = LitNot(y), f.c ^= 1;
+            else
+              f.op = OpXor, f.x = x, f.y = z;
+            f.z = 0;
+            continue;
+          }
+          // normalize
+          if(LitIsCompl(x))
+            x = LitNot(x), std::swap(y, z);
+          if(LitIsCompl(y))
+            y = LitNot(y), z = LitNot(z), f.c ^= 1;
+          break;
+        case OpExist:
+          if(x < 2) {
+            r = LitNotCond(x, f.c);
+            return true;
+          }
+          y = SkipCube(y, Level(x));
+          if(y == 1) {
+            r = LitNotCond(x, f.c);
+            return true;
+          }
+          break;
+        case OpAndExist:
+          if(x == 0 || y == 0) {
+            r = LitNotCond(0, f.c);
+            return true;
+          }
+          if(x == 1 || y == 1 || Lit2Bvar(x) == Lit2Bvar(y)) {
+            if(x != y && x > 1 && y > 1) {
+              r = LitNotCond(0, f.c);
+              return true;
+            }
+            f.op = OpExist, f.x = (x == 1)? y: x, f.y = z, f.z = 0;
+            continue;
+          }
+          if(x > y)
+            std::swap(x, y);
+          z = SkipCube(z, std::min(Level(x), Level(y)));
+          if(z == 1) {
+            f.op = OpAnd, f.x = x, f.y = y, f.z = 0;
+            continue;
+          }
+          break;
+        }
+        f.x = x, f.y = y, f.z = z;
+        lit h = fPar? cache->LookupPar(f.op, x, y, z): cache->Lookup(f.op, x, y, z);
+        if(h != LitMax()) {
+          r = LitNotCond(h, f.c);
+          return true;
+        }
+        f.v = Var(x);
+        if(Level(y) < Var2Level[f.v])
+          f.v = Var(y);
+        if(f.op == OpIte && Level(z) < Var2Level[f.v])
+          f.v = Var(z);
+        f.q = (f.op == OpExist && Var(y) == f.v) || (f.op == OpAndExist && Var(z) == f.v);
+        return false;
+      }
+    }
+    inline Frame ApplyChild(Frame const &f, bool c) const {
+      Frame g;
+      g.op = f.op;
+      g.c = false;
+      g.x = Cofactor(f.x, f.v, c);
+      g.y = f.y;
+      g.z = f.z;
+      switch(f.op) {
+      case OpAnd:
+      case OpXor:
+        g.y = Cofactor(f.y, f.v, c);
+        break;
+      case OpIte:
+        g.y = Cofactor(f.y, f.v, c);
+        g.z = Cofactor(f.z, f.v, c);
+        break;
+      case OpExist:
+        if(f.q)
+          g.y = Then(f.y);
+        break;
+      case OpAndExist:
+        g.y = Cofactor(f.y, f.v, c);
+        if(f.q)
+          g.z = Then(f.z);
+        break;
+      }
+      return g;
+    }
+    // apply engine
+    template <bool fPar>
+    lit Apply(int op, lit x, lit y, lit z, std::vector<Frame> &frames) {
+      size_t base = frames.size();
+      Frame g;
+      g.op = op, g.c = false, g.x = x, g.y = y, g.z = z;
+      lit r;
+      while(true) {
+        if(fPar && fAbort.load(std::memory_order_relaxed)) {
+          frames.resize(base);
+          return LitMax();
+        }
+        if(!ApplyEnter<fPar>(g, r)) {
+          g.state = 1;
+          frames.push_back(g);
+          g = ApplyChild(g, true);
+          continue;
+        }
+        // pass the result up until a frame needs another child
+        while(frames.size() > base) {
+          Frame &f = frames.back();
+          if(f.state == 1) {
+            if(!f.q || r != 1) {
+              f.r1 = r;
+              if(!fPar)
+                IncRef(r);
+              f.state = 2;
+              g = ApplyChild(f, false);
+              break;
+            }
+          } else if(f.state == 2) {
+            f.r0 = r;
+            if(!fPar)
+              IncRef(r);
+            if(f.q) {
+              f.state = 3;
+              g.op = OpAnd, g.c = true, g.x = LitNot(f.r1), g.y = LitNot(f.r0), g.z = 0;
+              break;
+            }
+            if(fPar) {
+              r = UniqueCreatePar(f.v, f.r1, f.r0);
+              if(r == LitMax()) {
+                frames.resize(base);
+                return r;
+              }
+            } else {
+              r = UniqueCreate(f.v, f.r1, f.r0);
+              DecRef(f.r1);
+              DecRef(f.r0);
+            }
+          } else {
+            DecRef(f.r1);
+            DecRef(f.r0);
+          }
+          if(fPar)
+            cache->InsertPar(f.op, f.x, f.y, f.z, r);
+          else
+            cache->Insert(f.op, f.x, f.y, f.z, r);
+          r = LitNotCond(r, f.c);
+          frames.pop_back();
+        }
+        if(frames.size() == base)
+          return r;
+      }
+    }
+
+    template <bool fPar>
+    inline std::vector<Frame> &Frames() {
+      if(fPar) {
+        static thread_local std::vector<Frame> vTaskFrames;
+        return vTaskFrames;
+      }
+      return vFrames;
+    }
+    // recursive And, continued on the explicit stack
+    template <bool fPar>
+    lit And_rec(lit x, lit y, int depth) {
       if(x == 0 || y == 1)
         return x;
       if(x == 1 || y == 0)
         return y;
       if(Lit2Bvar(x) == Lit2Bvar(y))
         return (x == y)? x: 0;
+      if(depth >= nRecDepth)
+        return Apply<fPar>(OpAnd, x, y, 0, Frames<fPar>());
       if(x > y)
         std::swap(x, y);
-      lit z = cache->Lookup(x, y);
+      if(fPar && fAbort.load(std::memory_order_relaxed))
+        return LitMax();
+      lit z = fPar? cache->LookupPar(OpAnd, x, y): cache->Lookup(OpAnd, x, y);
       if(z != LitMax())
         return z;
       var v;
@@ -442,63 +2109,250 @@ namespace NextBdd {
         v = Var(y), x0 = x1 = x, y1 = Then(y), y0 = Else(y);
       else
         v = Var(x), x1 = Then(x), x0 = Else(x), y1 = Then(y), y0 = Else(y);
-      lit z1 = And_rec(x1, y1);
+      lit z1 = And_rec<fPar>(x1, y1, depth + 1);
+      if(fPar) {
+        if(z1 == LitMax())
+          return z1;
+        lit z0 = And_rec<fPar>(x0, y0, depth + 1);
+        if(z0 == LitMax())
+          return z0;
+        z = UniqueCreatePar(v, z1, z0);
+        if(z == LitMax())
+          return z;
+        cache->InsertPar(OpAnd, x, y, z);
+        return z;
+      }
       IncRef(z1);
-      lit z0 = And_rec(x0, y0);
+      lit z0 = And_rec<fPar>(x0, y0, depth + 1);
       IncRef(z0);
       z = UniqueCreate(v, z1, z0);
       DecRef(z1);
       DecRef(z0);
-      cache->Insert(x, y, z);
+      cache->Insert(OpAnd, x, y, z);
+      return z;
+    }
+
+  private:
+    // per-thread batches of free nodes
+    inline bvar NewBvarPar() {
+      Batch &b = vBatches[TaskPool::Id()];
+      if(!b.Head && __atomic_load_n(&nObjs, __ATOMIC_RELAXED) < nObjsAlloc) {
+        bvar a = __atomic_fetch_add(&nObjs, 1, __ATOMIC_RELAXED);
+        if(a < nObjsAlloc)
+          return a;
+      }
+      if(!b.Head) {
+        std::lock_guard<std::mutex> l(mAlloc);
+        if(!RemovedHead)
+          return 0;
+        bvar a = b.Head = RemovedHead;
+        nAllocs++;
+        for(int i = 1; i < 256 && NextOfBvar(a); i++)
+          a = NextOfBvar(a), nAllocs++;
+        RemovedHead = NextOfBvar(a);
+        SetNextOfBvar(a, 0);
+      }
+      bvar a = b.Head;
+      b.Head = NextOfBvar(a);
+      return a;
+    }
+    inline void FreeBvarPar(bvar a) {
+      Batch &b = vBatches[TaskPool::Id()];
+      SetVarOfBvar(a, VarMax());
+      SetNextOfBvar(a, b.Head);
+      b.Head = a;
+    }
+#ifdef NEXT_BDD_OPEN
+    // lock the open table of v
+    inline lit UniqueCreateIntPar(var v, lit x1, lit x0) {
+      while(__atomic_exchange_n(&vUniqueLocks[v], 1, __ATOMIC_ACQUIRE))
+        std::this_thread::yield();
+      bool fFound;
+      size_t j = UniqueProbe(v, x1, x0, fFound);
+      lit x = LitMax();
+      if(fFound)
+        x = Bvar2Lit(vvUnique[v][j]);
+      else if(bvar a = NewBvarPar()) {
+        SetVarOfBvar(a, v);
+        SetThenOfBvar(a, x1);
+        SetElseOfBvar(a, x0);
+        UniqueInsertSlot(v, j, a);
+        if(UniqueFull(v))
+          ResizeUnique(v);
+        x = Bvar2Lit(a);
+      }
+      __atomic_store_n(&vUniqueLocks[v], 0, __ATOMIC_RELEASE);
+      return x;
+    }
+#else
+    // lock-free insertion for the parallel apply
+    inline lit UniqueCreateIntPar(var v, lit x1, lit x0) {
+      bvar *p = &vvUnique[v][UniqHash(x1, x0) & vUniqueMasks[v]];
+      bvar head = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+      bvar stop = 0;
+      bvar a = 0;
+      while(true) {
+        for(bvar q = head; q != stop; q = NextOfBvar(q))
+          if(VarOfBvar(q) == v && ThenOfBvar(q) == x1 && ElseOfBvar(q) == x0) {
+            if(a)
+              FreeBvarPar(a);
+            return Bvar2Lit(q);
+          }
+        if(!a) {
+          a = NewBvarPar();
+          if(!a)
+            return LitMax();
+          SetVarOfBvar(a, v);
+          SetThenOfBvar(a, x1);
+          SetElseOfBvar(a, x0);
+        }
+        SetNextOfBvar(a, head);
+        stop = head;
+        if(__atomic_compare_exchange_n(p, &head, a, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+          break;
+      }
+      __atomic_fetch_add(&vUniqueCounts[v], 1, __ATOMIC_RELAXED);
+      return Bvar2Lit(a);
+    }
+#endif
+    inline lit UniqueCreatePar(var v, lit x1, lit x0) {
+      if(x1 == x0)
+        return x1;
+      lit x;
+      if(!LitIsCompl(x0))
+        x = UniqueCreateIntPar(v, x1, x0);
+      else
+        x = UniqueCreateIntPar(v, LitNot(x1), LitNot(x0));
+      if(x == LitMax()) {
+        fAbort = true;
+        return x;
+      }
+      return LitIsCompl(x0)? LitNot(x): x;
+    }
+    // parallel And; running out of nodes aborts
+    lit AndPar_rec(lit x, lit y, int depth) {
+      if(depth >= nTaskDepth)
+        return And_rec<true>(x, y, depth);
+      if(x == 0 || y == 1)
+        return x;
+      if(x == 1 || y == 0)
+        return y;
+      if(Lit2Bvar(x) == Lit2Bvar(y))
+        return (x == y)? x: 0;
+      if(x > y)
+        std::swap(x, y);
+      if(fAbort.load(std::memory_order_relaxed))
+        return LitMax();
+      lit z = cache->LookupPar(OpAnd, x, y);
+      if(z != LitMax())
+        return z;
+      var v;
+      lit x0, x1, y0, y1;
+      if(Level(x) < Level(y))
+        v = Var(x), x1 = Then(x), x0 = Else(x), y0 = y1 = y;
+      else if(Level(x) > Level(y))
+        v = Var(y), x0 = x1 = x, y1 = Then(y), y0 = Else(y);
+      else
+        v = Var(x), x1 = Then(x), x0 = Else(x), y1 = Then(y), y0 = Else(y);
+      lit z1, z0;
+      TaskPool::Task t;
+      t.f = [&] { z0 = AndPar_rec(x0, y0, depth + 1); };
+      pool->Spawn(&t);
+      z1 = AndPar_rec(x1, y1, depth + 1);
+      pool->Wait(&t);
+      if(z1 == LitMax() || z0 == LitMax())
+        return LitMax();
+      z = UniqueCreatePar(v, z1, z0);
+      if(z == LitMax())
+        return z;
+      cache->InsertPar(OpAnd, x, y, z);
+      return z;
+    }
+    lit AndPar(lit x, lit y) {
+      lit z;
+      fAbort = false;
+      bvar nObjsOld = nObjs;
+      pool->Run([&] { z = AndPar_rec(x, y, 0); });
+      if(nObjs > nObjsAlloc)
+        nObjs = nObjsAlloc;
+      nAllocs += nObjs - nObjsOld;
+      vYoung.clear();
+      for(Batch &b: vBatches) {
+        while(b.Head) {
+          bvar a = b.Head;
+          b.Head = NextOfBvar(a);
+          SetNextOfBvar(a, RemovedHead);
+          RemovedHead = a;
+          nAllocs--;
+        }
+      }
+      for(var v = 0; v < nVars; v++)
+        while(UniqueFull(v))
+          ResizeUnique(v);
+      if(z == LitMax())
+        z = And_rec<false>(x, y, 0);
       return z;
     }
 
   private:
+    // edges into lower levels are released at the end
     bvar Swap(var i) {
+      static thread_local std::vector<lit> vDefer;
       var v1 = Level2Var[i];
       var v2 = Level2Var[i + 1];
       bvar f = 0;
       bvar diff = 0;
-      for(std::vector<bvar>::iterator p = vvUnique[v1].begin(); p != vvUnique[v1].end(); p++) {
-        std::vector<bvar>::iterator q = p;
+      vDefer.clear();
+      // take a node off the table of v1
+      auto Unlink = [&](bvar a) {
+        if(!EdgeOfBvar(a)) {
+          SetVarOfBvarPar(a, VarMax());
+          FreeBvar(a);
+          return true;
+        }
+        lit f1 = ThenOfBvar(a);
+        lit f0 = ElseOfBvar(a);
+        if(VarPar(f1) != v2 && VarPar(f0) != v2)
+          return false;
+        if(VarPar(f1) != v2)
+          vDefer.push_back(f1);
+        else if(!DecEdge(f1))
+          vDefer.push_back(Then(f1)), vDefer.push_back(Else(f1)), diff--;
+        if(VarPar(f0) != v2)
+          vDefer.push_back(f0);
+        else if(!DecEdge(f0))
+          vDefer.push_back(Then(f0)), vDefer.push_back(Else(f0)), diff--;
+        SetNextOfBvar(a, f);
+        f = a;
+        return true;
+      };
+#ifdef NEXT_BDD_OPEN
+      for(size_t j = 0; j < vvUnique[v1].size(); j++)
+        if(TagOfSlot(v1, j) >= 2 && Unlink(vvUnique[v1][j]))
+          UniqueEraseSlot(v1, j);
+#else
+      for(bvar *p = vvUnique[v1].data(); p != vvUnique[v1].data() + vvUnique[v1].size(); p++) {
+        bvar *q = p;
         while(*q) {
-          if(!EdgeOfBvar(*q)) {
-            SetVarOfBvar(*q, VarMax());
-            bvar next = vNexts[*q];
-            vNexts[*q] = RemovedHead;
-            RemovedHead = *q;
+          bvar next = NextOfBvar(*q);
+          if(Unlink(*q)) {
             *q = next;
             vUniqueCounts[v1]--;
             continue;
           }
-          lit f1 = ThenOfBvar(*q);
-          lit f0 = ElseOfBvar(*q);
-          if(Var(f1) == v2 || Var(f0) == v2) {
-            DecEdge(f1);
-            if(Var(f1) == v2 && !Edge(f1))
-              DecEdge(Then(f1)), DecEdge(Else(f1)), diff--;
-            DecEdge(f0);
-            if(Var(f0) == v2 && !Edge(f0))
-              DecEdge(Then(f0)), DecEdge(Else(f0)), diff--;
-            bvar next = vNexts[*q];
-            vNexts[*q] = f;
-            f = *q;
-            *q = next;
-            vUniqueCounts[v1]--;
-            continue;
-          }
-          q = vNexts.begin() + *q;
+          q = NextLink(*q);
         }
       }
+#endif
       while(f) {
         lit f1 = ThenOfBvar(f);
         lit f0 = ElseOfBvar(f);
         lit f00, f01, f10, f11;
-        if(Var(f1) == v2)
+        if(VarPar(f1) == v2)
           f11 = Then(f1), f10 = Else(f1);
         else
           f10 = f11 = f1;
-        if(Var(f0) == v2)
+        if(VarPar(f0) == v2)
           f01 = Then(f0), f00 = Else(f0);
         else
           f00 = f01 = f0;
@@ -510,7 +2364,9 @@ namespace NextBdd {
             IncEdge(f11), IncEdge(f01), diff++;
         }
         IncEdge(f1);
-        IncRef(f1);
+        // no collection while sifting in parallel
+        if(!fSwapPar)
+          IncRef(f1);
         if(f10 == f00)
           f0 = f10;
         else {
@@ -519,53 +2375,155 @@ namespace NextBdd {
             IncEdge(f10), IncEdge(f00), diff++;
         }
         IncEdge(f0);
-        DecRef(f1);
-        SetVarOfBvar(f, v2);
+        if(!fSwapPar)
+          DecRef(f1);
+        SetVarOfBvarPar(f, v2);
         SetThenOfBvar(f, f1);
         SetElseOfBvar(f, f0);
-        std::vector<bvar>::iterator q = vvUnique[v2].begin() + (UniqHash(f1, f0) & vUniqueMasks[v2]);
-        lit next = vNexts[f];
-        vNexts[f] = *q;
+        lit next = NextOfBvar(f);
+#ifdef NEXT_BDD_OPEN
+        // a dead duplicate gives its slot to f
+        bool fFound;
+        size_t j = UniqueProbe(v2, f1, f0, fFound);
+        if(fFound) {
+          bvar a = vvUnique[v2][j];
+          SetVarOfBvarPar(a, VarMax());
+          FreeBvar(a);
+          vvUnique[v2][j] = f;
+        } else {
+          UniqueInsertSlot(v2, j, f);
+          if(UniqueFull(v2))
+            ResizeUnique(v2);
+        }
+#else
+        bvar *q = &vvUnique[v2][UniqHash(f1, f0) & vUniqueMasks[v2]];
+        SetNextOfBvar(f, *q);
         *q = f;
         vUniqueCounts[v2]++;
+#endif
         f = next;
       }
+      for(lit x: vDefer)
+        DecEdge(x);
       Var2Level[v1] = i + 1;
       Var2Level[v2] = i;
       Level2Var[i] = v2;
       Level2Var[i + 1] = v1;
       return diff;
     }
-    void Sift() {
-      bvar count = CountNodes();
-      std::vector<var> sift_order(nVars);
-      for(var v = 0; v < nVars; v++)
-        sift_order[v] = v;
-      for(var i = 0; i < nVars; i++) {
+    // interaction matrix
+    void ComputeInteract() {
+      size_t nWords = ((size_t)nVars + 63) >> 6;
+      vInteract.assign(nWords * nVars, 0);
+      std::vector<size> supp(nWords);
+      for(bvar a = (bvar)nVars + 1; a < nObjs; a++) {
+        if(!RefOfBvar(a) || VarOfBvar(a) == VarMax() || EdgeOfBvar(a) != 1)
+          continue;
+        std::fill(supp.begin(), supp.end(), 0);
+        vStack.push_back(Bvar2Lit(a));
+        while(!vStack.empty()) {
+          lit x = vStack.back();
+          vStack.pop_back();
+          while(x >= 2 && !Mark(x)) {
+            SetMark(x);
+            supp[Var(x) >> 6] |= (size)1 << (Var(x) & 63);
+            if(Else(x) >= 2 && !Mark(Else(x)))
+              vStack.push_back(Else(x));
+            x = Then(x);
+          }
+        }
+        ResetMark_iter(Bvar2Lit(a));
+        for(var v = 0; v < nVars; v++)
+          if((supp[v >> 6] >> (v & 63)) & 1)
+            for(size_t w = 0; w < nWords; w++)
+              vInteract[v * nWords + w] |= supp[w];
+      }
+    }
+    // time budget of the current reorder
+    inline bool ReoTimeOut() const {
+      return ReoTimeLimit > 0 && std::chrono::steady_clock::now() > ReoDeadline;
+    }
+    inline bool Interact(var x, var y) const {
+      if(vInteract.empty() || x == y)
+        return true;
+      size_t nWords = ((size_t)nVars + 63) >> 6;
+      return (vInteract[x * nWords + (y >> 6)] >> (y & 63)) & 1;
+    }
+    // sift the variables at levels [lo, hi)
+    bvar Sift(var lo, var hi, bvar count, double Growth) {
+      bool fVerbose = fReoVerbose && !fSwapPar;
+      var n = hi - lo;
+      std::vector<var> sift_order(n);
+      for(var v = 0; v < n; v++)
+        sift_order[v] = Level2Var[lo + v];
+      // largest first, or by cost with fSiftCost
+      std::vector<double> vGains(nVars);
+      bvar total = 0;
+      for(var v = 0; v < n; v++)
+        total += vUniqueCounts[sift_order[v]];
+      bvar above = 0;
+      for(var v = 0; v < n; v++) {
+        var x = sift_order[v];
+        vGains[x] = vUniqueCounts[x];
+        if(fSiftCost) {
+          bvar below = total - above - vUniqueCounts[x];
+          vGains[x] /= 1.0 + below + above + std::min(above, below);
+        }
+        above += vUniqueCounts[x];
+      }
+      for(var i = 0; i < n; i++) {
         var max_j = i;
-        for(var j = i + 1; j < nVars; j++)
-          if(vUniqueCounts[sift_order[j]] > vUniqueCounts[sift_order[max_j]])
+        for(var j = i + 1; j < n; j++)
+          if(vGains[sift_order[j]] > vGains[sift_order[max_j]])
             max_j = j;
         if(max_j != i)
           std::swap(sift_order[max_j], sift_order[i]);
       }
-      for(var v = 0; v < nVars; v++) {
+      // lower bounds toward each end
+      auto Keys = [&](bvar l, bool fUp) {
+        var x = Level2Var[l];
+        bvar r = 0;
+        for(bvar k = fUp? lo: l; k < (fUp? l + 1: (bvar)hi); k++)
+          if(Interact(x, Level2Var[k]))
+            r += vUniqueCounts[Level2Var[k]];
+        return r;
+      };
+      // keys toward the end lose the passed variable
+      auto SwapBound = [&](bvar l, bvar &side, bool fUp) {
+        var x = Level2Var[fUp? l + 1: l];
+        var y = Level2Var[fUp? l: l + 1];
+        bvar k = vUniqueCounts[x] + (Interact(x, y)? vUniqueCounts[y]: 0);
+        bvar d = Swap(l);
+        side += vUniqueCounts[x] - k;
+        return d;
+      };
+      for(var v = 0; v < n && !ReoTimeOut(); v++) {
         bvar lev = Var2Level[sift_order[v]];
-        bool UpFirst = lev < (bvar)(nVars / 2);
+        bool UpFirst = lev < (bvar)((lo + hi) / 2);
+        if(fSiftCost) {
+          // cheaper side first
+          UpFirst = Keys(lev, true) < Keys(lev, false);
+        }
         bvar min_lev = lev;
         bvar min_diff = 0;
         bvar diff = 0;
-        bvar thold = count * (MaxGrowth - 1);
-        if(fReoVerbose)
+        bvar thold = count * Growth;
+        if(fVerbose)
           std::cout << "Sift " << sift_order[v] << " : Level = " << lev << " Count = " << count << " Thold = " << thold << std::endl;
         if(UpFirst) {
           lev--;
-          for(; lev >= 0; lev--) {
-            diff += Swap(lev);
-            if(fReoVerbose)
+          bvar side = fSiftBound? Keys(lev + 1, true): 0;
+          for(; lev >= (bvar)lo; lev--) {
+            if(fSiftBound) {
+              if(diff - side > min_diff)
+                break;
+              diff += SwapBound(lev, side, true);
+            } else
+              diff += Swap(lev);
+            if(fVerbose)
               std::cout << "\tSwap " << lev << " : Diff = " << diff << " Thold = " << thold << std::endl;
             if(diff < min_diff)
-              min_lev = lev, min_diff = diff, thold = (count + diff) * (MaxGrowth - 1);
+              min_lev = lev, min_diff = diff, thold = (count + diff) * Growth;
             else if(diff > thold) {
               lev--;
               break;
@@ -573,12 +2531,18 @@ namespace NextBdd {
           }
           lev++;
         }
-        for(; lev < (bvar)nVars - 1; lev++) {
-          diff += Swap(lev);
-          if(fReoVerbose)
+        bvar side = fSiftBound? Keys(lev, false): 0;
+        for(; lev < (bvar)hi - 1; lev++) {
+          if(fSiftBound) {
+            if(diff - side > min_diff)
+              break;
+            diff += SwapBound(lev, side, false);
+          } else
+            diff += Swap(lev);
+          if(fVerbose)
             std::cout << "\tSwap " << lev << " : Diff = " << diff << " Thold = " << thold << std::endl;
           if(diff <= min_diff)
-            min_lev = lev + 1, min_diff = diff, thold = (count + diff) * (MaxGrowth - 1);
+            min_lev = lev + 1, min_diff = diff, thold = (count + diff) * Growth;
           else if(diff > thold) {
             lev++;
             break;
@@ -588,16 +2552,22 @@ namespace NextBdd {
         if(UpFirst) {
           for(; lev >= min_lev; lev--) {
             diff += Swap(lev);
-            if(fReoVerbose)
+            if(fVerbose)
               std::cout << "\tSwap " << lev << " : Diff = " << diff << " Thold = " << thold << std::endl;
           }
         } else {
-          for(; lev >= 0; lev--) {
-            diff += Swap(lev);
-            if(fReoVerbose)
+          side = fSiftBound? Keys(lev + 1, true): 0;
+          for(; lev >= (bvar)lo; lev--) {
+            if(fSiftBound) {
+              if(diff - side > min_diff)
+                break;
+              diff += SwapBound(lev, side, true);
+            } else
+              diff += Swap(lev);
+            if(fVerbose)
               std::cout << "\tSwap " << lev << " : Diff = " << diff << " Thold = " << thold << std::endl;
             if(diff <= min_diff)
-              min_lev = lev, min_diff = diff, thold = (count + diff) * (MaxGrowth - 1);
+              min_lev = lev, min_diff = diff, thold = (count + diff) * Growth;
             else if(diff > thold) {
               lev--;
               break;
@@ -606,14 +2576,227 @@ namespace NextBdd {
           lev++;
           for(; lev < min_lev; lev++) {
             diff += Swap(lev);
-            if(fReoVerbose)
+            if(fVerbose)
               std::cout << "\tSwap " << lev << " : Diff = " << diff << " Thold = " << thold << std::endl;
           }
         }
         count += min_diff;
-        if(fReoVerbose)
+        if(fVerbose)
           std::cout << "Sifted " << sift_order[v] << " : Level = " << min_lev << " Count = " << count << " Thold = " << thold << std::endl;
       }
+      return count;
+    }
+    void Sift() {
+      Sift(0, nVars, CountNodes(), MaxGrowth - 1);
+    }
+    // sift disjoint windows in parallel
+    void SiftPar() {
+      var nWindows = pool->Size();
+      var width = (nVars + nWindows - 1) / nWindows;
+      if(width < 4) {
+        Sift();
+        return;
+      }
+      bvar count = CountNodes();
+      for(int round = 0; round < 2; round++) {
+        std::vector<var> vBounds(1, 0);
+        for(var lev = round? width / 2: width; lev < nVars; lev += width)
+          vBounds.push_back(lev);
+        vBounds.push_back(nVars);
+        size_t nTasks = vBounds.size() - 1;
+        std::vector<bvar> vCounts(nTasks);
+        std::vector<std::exception_ptr> vErrors(nTasks);
+        fSwapPar = true;
+        pool->For(nTasks, [&](size_t k) {
+          try {
+            vCounts[k] = Sift(vBounds[k], vBounds[k + 1], count, (MaxGrowth - 1) / nTasks);
+          } catch(...) {
+            vErrors[k] = std::current_exception();
+          }
+        });
+        fSwapPar = false;
+        for(size_t k = 0; k < nTasks; k++)
+          if(vErrors[k])
+            std::rethrow_exception(vErrors[k]);
+        bvar base = count;
+        for(size_t k = 0; k < nTasks; k++)
+          count += vCounts[k] - base;
+        if(fReoVerbose)
+          std::cout << "Sifted " << nTasks << " windows in parallel : Count = " << count << std::endl;
+      }
+    }
+
+    // sift to convergence
+    void SiftConv() {
+      bvar count = CountNodes();
+      while(true) {
+        bvar prev = count;
+        count = Sift(0, nVars, count, MaxGrowth - 1);
+        if(fReoVerbose)
+          std::cout << "Sifting pass : Count = " << count << std::endl;
+        if(prev - count <= prev * MinGain || ReoTimeOut())
+          break;
+      }
+    }
+    // Steinhaus-Johnson-Trotter transpositions
+    static std::vector<var> Transpositions(var k) {
+      std::vector<var> vSeq, perm(k);
+      std::vector<char> left(k, true);
+      for(var i = 0; i < k; i++)
+        perm[i] = i;
+      while(true) {
+        int m = -1;
+        for(var i = 0; i < k; i++) {
+          int j = left[i]? (int)i - 1: (int)i + 1;
+          if(j >= 0 && j < (int)k && perm[j] < perm[i] && (m < 0 || perm[i] > perm[m]))
+            m = i;
+        }
+        if(m < 0)
+          return vSeq;
+        int j = left[m]? m - 1: m + 1;
+        var e = perm[m];
+        std::swap(perm[m], perm[j]);
+        std::swap(left[m], left[j]);
+        vSeq.push_back(std::min(m, j));
+        for(var i = 0; i < k; i++)
+          if(perm[i] > e)
+            left[i] = !left[i];
+      }
+    }
+    // window permutation
+    void Window(var k) {
+      if(k > nVars)
+        return;
+      std::vector<var> vSeq = Transpositions(k);
+      bvar count = CountNodes();
+      for(var lev = 0; lev + k <= nVars && !ReoTimeOut(); lev++) {
+        std::vector<var> best(Level2Var.begin() + lev, Level2Var.begin() + lev + k);
+        bvar diff = 0;
+        bvar min_diff = 0;
+        for(var s: vSeq) {
+          diff += Swap(lev + s);
+          if(diff < min_diff) {
+            min_diff = diff;
+            best.assign(Level2Var.begin() + lev, Level2Var.begin() + lev + k);
+          }
+        }
+        for(var i = 0; i < k; i++)
+          for(var j = Var2Level[best[i]]; j > lev + i; j--)
+            diff += Swap(j - 1);
+        count += diff;
+        if(fReoVerbose)
+          std::cout << "Window " << lev << " : Count = " << count << std::endl;
+      }
+    }
+    // symmetric variables at adjacent levels
+    bool SymmCheck(var i) {
+      var v1 = Level2Var[i];
+      var v2 = Level2Var[i + 1];
+      bool fSymm = true;
+      bool fSymmC = true;
+      edge arcs = 0;
+      bool fDone = ForEachUnique(v1, [&](bvar a) {
+        // skip dead nodes
+        if(!EdgeOfBvar(a) || (a <= (bvar)nVars && EdgeOfBvar(a) == 1))
+          return true;
+        lit f1 = ThenOfBvar(a);
+        lit f0 = ElseOfBvar(a);
+        lit f11, f10, f01, f00;
+        if(Var(f1) == v2)
+          arcs++, f11 = Then(f1), f10 = Else(f1);
+        else if(Var(f0) != v2)
+          return false;
+        else
+          f11 = f10 = f1;
+        if(Var(f0) == v2)
+          arcs++, f01 = Then(f0), f00 = Else(f0);
+        else
+          f01 = f00 = f0;
+        fSymm &= f10 == f01;
+        fSymmC &= f11 == f00;
+        return fSymm || fSymmC;
+      });
+      if(!fDone)
+        return false;
+      edge total = 0;
+      ForEachUnique(v2, [&](bvar a) {
+        total += EdgeOfBvar(a);
+        return true;
+      });
+      return arcs == total - 1;
+    }
+    // move a block of a levels below the next b
+    bvar MoveDown(var lev, var a, var b) {
+      bvar diff = 0;
+      for(var k = a; k > 0; k--)
+        for(var j = 0; j < b; j++)
+          diff += Swap(lev + k - 1 + j);
+      return diff;
+    }
+    // sift groups of adjacent symmetric variables as blocks
+    void GroupSift() {
+      bvar count = CountNodes();
+      std::vector<var> vSizes;
+      std::vector<var> vFirsts;
+      std::vector<bvar> vCounts;
+      for(var i = 0; i < nVars; i++) {
+        if(i && SymmCheck(i - 1)) {
+          vSizes.back()++;
+          vCounts.back() += vUniqueCounts[Level2Var[i]];
+          continue;
+        }
+        vSizes.push_back(1);
+        vFirsts.push_back(Level2Var[i]);
+        vCounts.push_back(vUniqueCounts[Level2Var[i]]);
+      }
+      var nGroups = vSizes.size();
+      std::vector<var> sift_order(nGroups);
+      for(var g = 0; g < nGroups; g++)
+        sift_order[g] = g;
+      std::stable_sort(sift_order.begin(), sift_order.end(), [&](var a, var b) { return vCounts[a] > vCounts[b]; });
+      for(var o = 0; o < nGroups && !ReoTimeOut(); o++) {
+        var first = vFirsts[sift_order[o]];
+        var g = 0, top = 0;
+        while(Level2Var[top] != first)
+          top += vSizes[g++];
+        bvar diff = 0;
+        bvar min_diff = 0;
+        var min_g = g;
+        bvar thold = count * (MaxGrowth - 1);
+        auto Up = [&]() {
+          diff += MoveDown(top - vSizes[g - 1], vSizes[g - 1], vSizes[g]);
+          top -= vSizes[g - 1];
+          std::swap(vSizes[g - 1], vSizes[g]);
+          g--;
+        };
+        auto Down = [&]() {
+          diff += MoveDown(top, vSizes[g], vSizes[g + 1]);
+          top += vSizes[g + 1];
+          std::swap(vSizes[g], vSizes[g + 1]);
+          g++;
+        };
+        bool UpFirst = top < nVars / 2;
+        for(int pass = 0; pass < 2; pass++) {
+          bool fUp = (pass == 0) == UpFirst;
+          while(fUp? g > 0: g + 1 < nGroups) {
+            if(fUp)
+              Up();
+            else
+              Down();
+            if(diff < min_diff)
+              min_g = g, min_diff = diff, thold = (count + diff) * (MaxGrowth - 1);
+            else if(diff > thold)
+              break;
+          }
+        }
+        while(g > min_g)
+          Up();
+        while(g < min_g)
+          Down();
+        count += diff;
+        if(fReoVerbose)
+          std::cout << "Sifted group of " << vSizes[g] << " from " << first << " : Level = " << top << " Count = " << count << std::endl;
+      }
     }
 
   public:
@@ -644,55 +2827,126 @@ namespace NextBdd {
       uniq nUniqueSize = (uniq)1 << p.nUniqueSizeLog;
       if(!nUniqueSize)
         throw std::length_error("Memout (nUniqueSize) in init");
-      // allocation
-      if(nVerbose)
-        std::cout << "Allocating " << nObjsAlloc << " nodes and " << nVars << " x " << nUniqueSize << " unique table entries" << std::endl;
-      vVars.resize(nObjsAlloc);
-      vObjs.resize((lit)nObjsAlloc * 2);
-      vNexts.resize(nObjsAlloc);
-      vMarks.resize(nObjsAlloc);
-      vvUnique.resize(nVars);
-      vUniqueMasks.resize(nVars);
-      vUniqueCounts.resize(nVars);
-      vUniqueTholds.resize(nVars);
-      for(var v = 0; v < nVars; v++) {
-        vvUnique[v].resize(nUniqueSize);
-        vUniqueMasks[v] = nUniqueSize - 1;
-        if((lit)(nUniqueSize * p.UniqueDensity) > (lit)BvarMax())
-          vUniqueTholds[v] = BvarMax();
-        else
-          vUniqueTholds[v] = (bvar)(nUniqueSize * p.UniqueDensity);
-      }
-      if(p.fCountOnes) {
-        if(nVars > 1023)
-          throw std::length_error("nVars must be less than 1024 to count ones");
-        vOneCounts.resize(nObjsAlloc);
-      }
+      if(p.nReoWindow < 2 || p.nReoWindow > 4)
+        throw std::invalid_argument("nReoWindow must be between 2 and 4");
+      if(p.nThreads < 1)
+        throw std::invalid_argument("nThreads must be positive");
       // set up cache
-      cache = new Cache(p.nCacheSizeLog, p.nCacheMaxLog, p.nCacheVerbose);
-      // create nodes for variables
-      nObjs = 1;
-      vVars[0] = VarMax();
-      for(var v = 0; v < nVars; v++)
-        UniqueCreateInt(v, 1, 0);
-      // set up variable order
-      Var2Level.resize(nVars);
-      Level2Var.resize(nVars);
-      for(var v = 0; v < nVars; v++) {
-        if(p.pVar2Level)
-          Var2Level[v] = (*p.pVar2Level)[v];
-        else
-          Var2Level[v] = v;
-        Level2Var[Var2Level[v]] = v;
+      pBudget = p.pBudget;
+      cache = new Cache(p.nCacheSizeLog, p.nCacheMaxLog, p.nCacheWays, p.CacheMinGain, p.nCacheVerbose, pBudget);
+      pool = NULL;
+      pBdds = NULL;
+      if(pBudget && !pBudget->BorrowNodes(nObjsAlloc)) {
+        delete cache;
+        throw std::length_error("Memout (budget) in init");
+      }
+      // undo on failure
+      try {
+        // allocation
+        if(nVerbose)
+          std::cout << "Allocating " << nObjsAlloc << " nodes and " << nVars << " x " << nUniqueSize << " unique table entries" << std::endl;
+#ifdef NEXT_BDD_PACKED
+        fRefs = false;
+#endif
+        ReserveNodes(p.nHugePage);
+        ResizeNodes();
+        vvUnique.resize(nVars);
+        vUniqueMasks.resize(nVars);
+        vUniqueCounts.resize(nVars);
+        vUniqueTholds.resize(nVars);
+#ifdef NEXT_BDD_OPEN
+        // open tables fill up to 7/8 of their slots
+        if(nUniqueSize < 8)
+          nUniqueSize = 8;
+        vvUniqueTags.resize(nVars);
+        vUniqueTombs.resize(nVars);
+        vUniqueLocks.resize(nVars);
+        for(var v = 0; v < nVars; v++) {
+          vvUnique[v].resize(nUniqueSize);
+          vvUniqueTags[v].resize(nUniqueSize >> 3);
+          vUniqueMasks[v] = (nUniqueSize >> 3) - 1;
+          if((lit)((nUniqueSize >> 3) * 7) > (lit)BvarMax())
+            vUniqueTholds[v] = BvarMax();
+          else
+            vUniqueTholds[v] = (bvar)((nUniqueSize >> 3) * 7);
+        }
+#else
+        for(var v = 0; v < nVars; v++) {
+          vvUnique[v].resize(nUniqueSize);
+          vUniqueMasks[v] = nUniqueSize - 1;
+          if((lit)(nUniqueSize * p.UniqueDensity) > (lit)BvarMax())
+            vUniqueTholds[v] = BvarMax();
+          else
+            vUniqueTholds[v] = (bvar)(nUniqueSize * p.UniqueDensity);
+        }
+#endif
+        // set up threads
+        if(p.nThreads > 1) {
+          if(nVerbose)
+            std::cout << "Starting " << p.nThreads << " threads" << std::endl;
+          pool = new TaskPool(p.nThreads);
+          vBatches.assign(p.nThreads, Batch{0});
+          cache->SetConcurrent();
+        }
+        nTaskDepth = p.nTaskDepth;
+        nRecDepth = p.nRecDepth;
+        nGbc = p.nGbc;
+        fSwapPar = false;
+        nMinorSkips = 0;
+        nMinorGbcs = nMajorGbcs = nGbcFreed = 0;
+        GbcTime = GbcMaxPause = 0;
+        nReadPeakLive = 0;
+        nReadPeakHeld = 0;
+        vFrames.reserve(2 * (size_t)nVars + 4);
+        // create nodes for variables
+        nObjs = 1;
+        SetVarOfBvar(0, VarMax());
+        for(var v = 0; v < nVars; v++)
+          UniqueCreateInt(v, 1, 0);
+        // variable nodes are never collected
+        vYoung.clear();
+        // set up variable order
+        Var2Level.resize(nVars);
+        Level2Var.resize(nVars);
+        for(var v = 0; v < nVars; v++) {
+          if(p.pVar2Level)
+            Var2Level[v] = (*p.pVar2Level)[v];
+          else
+            Var2Level[v] = v;
+          Level2Var[Var2Level[v]] = v;
+        }
+        // set other parameters
+        RemovedHead = 0;
+        nReo = p.nReo;
+        nReoCheck = nReo == BvarMax()? SizeMax(): nReo;
+        nAllocs = nAllocsLast = 0;
+        nReoBackoff = 1;
+        MaxGrowth = p.MaxGrowth;
+        ReoMinGain = p.ReoMinGain;
+        ReoTimeLimit = p.ReoTimeLimit;
+        nReoGbcs = p.nReoGbcs;
+        nGbcsSinceReo = 0;
+        ReoLast = std::chrono::steady_clock::now();
+        fReoVerbose = p.fReoVerbose;
+        fReoPar = p.fReoPar;
+        fSiftBound = p.fSiftBound;
+        fSiftCost = p.fSiftCost;
+        nReoMethod = p.nReoMethod;
+        nReoWindow = p.nReoWindow;
+        MinGain = p.MinGain;
+        nReos = 0;
+        ReoTime = 0;
+        nReoBefore = 0;
+        nReoAfter = 0;
+        if(nGbc || nReo != BvarMax())
+          ClearRefs();
+      } catch(...) {
+        delete cache;
+        delete pool;
+        if(pBudget)
+          pBudget->ReturnNodes(nObjsAlloc);
+        throw;
       }
-      // set other parameters
-      RemovedHead = 0;
-      nGbc = p.nGbc;
-      nReo = p.nReo;
-      MaxGrowth = p.MaxGrowth;
-      fReoVerbose = p.fReoVerbose;
-      if(nGbc || nReo != BvarMax())
-        vRefs.resize(nObjsAlloc);
     }
     ~Man() {
       if(nVerbose) {
@@ -704,46 +2958,509 @@ namespace NextBdd {
           delim = ", ";
         }
         std::cout << "} unique table entries" << std::endl;
-        if(!vRefs.empty())
-          std::cout << "Free " << vRefs.size() << " refs" << std::endl;
+        if(HasRefs())
+          std::cout << "Free " << nObjsAlloc << " refs" << std::endl;
       }
       delete cache;
+      delete pool;
+      if(pBudget)
+        pBudget->ReturnNodes(nObjsAlloc);
     }
     void Reorder() {
       if(nVerbose >= 2)
         std::cout << "Reorder" << std::endl;
+      auto t0 = std::chrono::steady_clock::now();
+      ReoDeadline = t0 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(ReoTimeLimit));
       int nGbc_ = nGbc;
       nGbc = 0;
       CountEdges();
-      Sift();
+      nReoBefore = CountNodes();
+      if(fSiftBound && (nReoMethod == ReoSift || nReoMethod == ReoSiftConv))
+        ComputeInteract();
+      switch(nReoMethod) {
+      case ReoWindow:
+        Window(nReoWindow);
+        break;
+      case ReoGroupSift:
+        GroupSift();
+        break;
+      case ReoSiftConv:
+        SiftConv();
+        break;
+      default:
+#ifdef NEXT_BDD_MMAP
+        // storage must stay in place
+        if(fReoPar && pool)
+          SiftPar();
+        else
+#endif
+          Sift();
+      }
+      nReoAfter = CountNodes();
       vEdges.clear();
+      vInteract.clear();
+      vYoung.clear();
       cache->Clear();
       nGbc = nGbc_;
+      double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      nReos++;
+      ReoTime += t;
+      if(nVerbose || fReoVerbose)
+        std::cout << "Reorder: " << nReoAfter << " nodes in " << t << " s" << std::endl;
     }
-    inline lit And(lit x, lit y) {
-      if(nObjs > nReo) {
-        Reorder();
-        while(nReo < nObjs) {
-          nReo <<= 1;
-          if((lit)nReo > (lit)BvarMax())
-            nReo = BvarMax();
-        }
+    // sum the live nodes past the check mark
+    inline void ReorderIfNeeded() {
+      if(nAllocs > nReoCheck)
+        ReorderIfNeededInt();
+    }
+    // reorder past the threshold or on thrashing
+    void ReorderIfNeededInt() {
+      bvar live = CountLive();
+      bool fThrash = nReoGbcs && nGbcsSinceReo >= nReoGbcs && live > nReo / 2;
+      if(live <= nReo && !fThrash) {
+        SetReoCheck(live);
+        return;
       }
-      return And_rec(x, y);
+      auto t0 = std::chrono::steady_clock::now();
+      double tOps = std::chrono::duration<double>(t0 - ReoLast).count();
+      size nOps = nAllocs - nAllocsLast;
+      size nStart = nAllocs;
+      Reorder();
+      ReoLast = std::chrono::steady_clock::now();
+      double t = std::chrono::duration<double>(ReoLast - t0).count();
+      bvar after = CountLive();
+      bool fCheap = ReoTimeLimit > 0? t <= tOps: nAllocs - nStart <= nOps;
+      nAllocsLast = nAllocs;
+      bool fPaid = nReoAfter < nReoBefore && nReoBefore - nReoAfter >= nReoBefore * ReoMinGain && fCheap;
+      if(fPaid)
+        nReoBackoff = 1;
+      else if(nReoBackoff < 64)
+        nReoBackoff *= 2;
+      size next = (size)std::max(after, nReo / 2) * 2 * nReoBackoff;
+      nReo = next > (size)BvarMax()? BvarMax(): (bvar)next;
+      nGbcsSinceReo = 0;
+      if(fReoVerbose)
+        std::cout << "Reorder trigger: " << live << " live nodes" << (fThrash? " (thrash)": "") << ", "
+                  << (fPaid? "paid off": "backoff " + std::to_string(nReoBackoff)) << ", next at " << nReo << std::endl;
+      SetReoCheck(after);
+    }
+    // next check after nReo - live allocations
+    inline void SetReoCheck(bvar live) {
+      nReoCheck = nReo == BvarMax()? SizeMax(): nAllocs + (nReo - live);
+    }
+    inline lit And(lit x, lit y) {
+      ReorderIfNeeded();
+      if(pool)
+        return AndPar(x, y);
+      return And_rec<false>(x, y, 0);
     }
     inline lit Or(lit x, lit y) {
       return LitNot(And(LitNot(x), LitNot(y)));
     }
+    inline lit Xor(lit x, lit y) {
+      ReorderIfNeeded();
+      return Apply<false>(OpXor, x, y, 0, vFrames);
+    }
+    inline lit Xnor(lit x, lit y) {
+      return LitNot(Xor(x, y));
+    }
+    inline lit Ite(lit f, lit g, lit h) {
+      ReorderIfNeeded();
+      return Apply<false>(OpIte, f, g, h, vFrames);
+    }
+    lit Cube(std::vector<var> const &vCubeVars) {
+      lit cube = Const1();
+      for(size_t i = 0; i < vCubeVars.size(); i++) {
+        IncRef(cube);
+        lit x = And(cube, IthVar(vCubeVars[i]));
+        DecRef(cube);
+        cube = x;
+      }
+      return cube;
+    }
+    inline lit Exist(lit x, lit cube) {
+      ReorderIfNeeded();
+      return Apply<false>(OpExist, x, cube, 0, vFrames);
+    }
+    inline lit AndExist(lit x, lit y, lit cube) {
+      ReorderIfNeeded();
+      return Apply<false>(OpAndExist, x, y, cube, vFrames);
+    }
 
   public:
     void SetRef(std::vector<lit> const &vLits) {
-      vRefs.clear();
-      vRefs.resize(nObjsAlloc);
+      ClearRefs();
+      for(size_t i = 0; i < vLits.size(); i++)
+        IncRef(vLits[i]);
+    }
+    // write the nodes of vLits in the format of Image
+    void Save(std::string const &name, std::vector<lit> const &vLits) {
+      std::vector<std::vector<bvar> > vvLevels(nVars);
+      for(size_t i = 0; i < vLits.size(); i++) {
+        vStack.push_back(vLits[i]);
+        while(!vStack.empty()) {
+          lit x = vStack.back();
+          vStack.pop_back();
+          while(x >= 2 && !Mark(x)) {
+            SetMark(x);
+            vvLevels[Level(x)].push_back(Lit2Bvar(x));
+            if(Else(x) >= 2 && !Mark(Else(x)))
+              vStack.push_back(Else(x));
+            x = Then(x);
+          }
+        }
+      }
       for(size_t i = 0; i < vLits.size(); i++)
+        ResetMark_iter(vLits[i]);
+      std::vector<bvar> vIndex(nObjs);
+      std::vector<uint64_t> vStarts(1, 1);
+      bvar nNodes = 0;
+      for(var lev = nVars; lev > 0; lev--) {
+        for(size_t i = 0; i < vvLevels[lev - 1].size(); i++)
+          vIndex[vvLevels[lev - 1][i]] = ++nNodes;
+        vStarts.push_back(nNodes + 1);
+      }
+      auto Index = [&](lit x) { return x < 2? (size)0: (size)vIndex[Lit2Bvar(x)]; };
+      std::vector<size> vFields(2 * (size)nNodes);
+      size nMax = 0;
+      for(var lev = 0; lev < nVars; lev++) {
+        for(size_t i = 0; i < vvLevels[lev].size(); i++) {
+          bvar a = vvLevels[lev][i];
+          size k = vIndex[a];
+          vFields[2 * k - 2] = ((k - Index(ThenOfBvar(a))) << 1) | LitIsCompl(ThenOfBvar(a));
+          vFields[2 * k - 1] = k - Index(ElseOfBvar(a));
+          nMax = std::max(nMax, std::max(vFields[2 * k - 2], vFields[2 * k - 1]));
+        }
+      }
+      FileHeader Header;
+      std::memcpy(Header.Magic, "NBDD", 4);
+      Header.nVersion = 1;
+      Header.nVars = nVars;
+      Header.nWidth = 1;
+      while(Header.nWidth < 8 && (nMax >> (8 * Header.nWidth)))
+        Header.nWidth++;
+      Header.nNodes = nNodes;
+      Header.nRoots = vLits.size();
+      std::ofstream f(name, std::ios::binary);
+      if(!f)
+        throw std::runtime_error("Cannot open " + name);
+      const char zeros[8] = {0};
+      auto Write = [&](const void *p, size n) {
+        f.write((const char *)p, n);
+        if(n & 7)
+          f.write(zeros, 8 - (n & 7));
+      };
+      unsigned char Head[sizeof(FileHeader)];
+      std::memcpy(Head, Header.Magic, 4);
+      StoreLe(Head + 4, Header.nVersion, 4);
+      StoreLe(Head + 8, Header.nVars, 4);
+      StoreLe(Head + 12, Header.nWidth, 4);
+      StoreLe(Head + 16, Header.nNodes, 8);
+      StoreLe(Head + 24, Header.nRoots, 8);
+      Write(Head, sizeof(Head));
+      std::vector<unsigned char> vBytes(4 * (size)nVars);
+      for(var lev = 0; lev < nVars; lev++)
+        StoreLe(vBytes.data() + 4 * lev, Level2Var[lev], 4);
+      Write(vBytes.data(), vBytes.size());
+      vBytes.resize(8 * vStarts.size());
+      for(size_t i = 0; i < vStarts.size(); i++)
+        StoreLe(vBytes.data() + 8 * i, vStarts[i], 8);
+      Write(vBytes.data(), vBytes.size());
+      vBytes.resize(8 * vLits.size());
+      for(size_t i = 0; i < vLits.size(); i++)
+        StoreLe(vBytes.data() + 8 * i, (Index(vLits[i]) << 1) | LitIsCompl(vLits[i]), 8);
+      Write(vBytes.data(), vBytes.size());
+      std::vector<unsigned char> vEdgeBytes(vFields.size() * Header.nWidth);
+      for(size_t i = 0; i < vFields.size(); i++)
+        StoreLe(vEdgeBytes.data() + i * Header.nWidth, vFields[i], Header.nWidth);
+      Write(vEdgeBytes.data(), vEdgeBytes.size());
+      if(!f)
+        throw std::runtime_error("Cannot write " + name);
+    }
+    // number of inputs of an AIGER file
+    static int AigerInputs(std::string const &name) {
+      std::ifstream f(name, std::ios::binary);
+      std::string tag;
+      int M, I;
+      if(!(f >> tag >> M >> I) || tag != "aig")
+        throw std::runtime_error("Invalid AIGER file " + name);
+      return I;
+    }
+    // parse a combinational binary AIGER file
+    static void ParseAiger(std::string const &name, unsigned &I, std::vector<unsigned> &vPos, std::vector<unsigned> &vFanins) {
+      std::ifstream f(name, std::ios::binary);
+      std::string tag;
+      unsigned M, L, O, A;
+      if(!(f >> tag >> M >> I >> L >> O >> A) || tag != "aig" || M != I + L + A)
+        throw std::runtime_error("Invalid AIGER file " + name);
+      if(L)
+        throw std::invalid_argument("Latches are not supported");
+      vPos.resize(O);
+      for(unsigned i = 0; i < O; i++)
+        f >> vPos[i];
+      if(!f)
+        throw std::runtime_error("Invalid AIGER file " + name);
+      for(unsigned i = 0; i < O; i++)
+        if(vPos[i] > 2 * M + 1)
+          throw std::runtime_error("Invalid AIGER file " + name);
+      f.get();
+      auto Decode = [&]() {
+        unsigned x = 0, k = 0;
+        int c;
+        while((c = f.get()) & 0x80) {
+          if(c == EOF || k == 4)
+            throw std::runtime_error("Invalid AIGER file " + name);
+          x |= (unsigned)(c & 0x7f) << (7 * k++);
+        }
+        if(k == 4 && (c >> 4))
+          throw std::runtime_error("Invalid AIGER file " + name);
+        return x | ((unsigned)c << (7 * k));
+      };
+      vFanins.resize(2 * (size_t)A);
+      for(unsigned i = 0; i < A; i++) {
+        unsigned lhs = 2 * (I + 1 + i);
+        unsigned x = lhs - Decode();
+        unsigned d = Decode();
+        unsigned y = x - d;
+        if(!f || x >= lhs || d > x)
+          throw std::runtime_error("Invalid AIGER file " + name);
+        vFanins[2 * i] = x;
+        vFanins[2 * i + 1] = y;
+      }
+    }
+    // build the outputs of an AIGER file, each referenced
+    std::vector<lit> ReadAiger(std::string const &name, std::vector<int> const &vValues = std::vector<int>()) {
+      unsigned I;
+      std::vector<unsigned> vPos, vFanins;
+      ParseAiger(name, I, vPos, vFanins);
+      unsigned O = vPos.size();
+      unsigned A = vFanins.size() / 2;
+      if(I > nVars)
+        throw std::invalid_argument("AIGER file has more inputs than the manager");
+      std::vector<unsigned> vDepths(I + A + 1);
+      std::vector<unsigned> vCounts(I + A + 1);
+      for(unsigned i = 0; i < A; i++)
+        vDepths[I + 1 + i] = std::max(vDepths[vFanins[2 * i] >> 1], vDepths[vFanins[2 * i + 1] >> 1]) + 1;
+      // order the reachable ANDs and count their fanouts
+      std::vector<unsigned> vOrder;
+      std::vector<char> vVisited(I + A + 1);
+      std::vector<unsigned> vDfs;
+      for(unsigned i = 0; i < O; i++) {
+        vCounts[vPos[i] >> 1]++;
+        vDfs.push_back(vPos[i] >> 1);
+        while(!vDfs.empty()) {
+          unsigned n = vDfs.back();
+          if(n <= I || vVisited[n] == 2) {
+            vDfs.pop_back();
+            continue;
+          }
+          unsigned x = vFanins[2 * (n - I - 1)] >> 1;
+          unsigned y = vFanins[2 * (n - I - 1) + 1] >> 1;
+          if(!vVisited[n]) {
+            vVisited[n] = 1;
+            vCounts[x]++;
+            vCounts[y]++;
+            if(vDepths[x] < vDepths[y])
+              std::swap(x, y);
+            vDfs.push_back(y);
+            vDfs.push_back(x);
+            continue;
+          }
+          vVisited[n] = 2;
+          vOrder.push_back(n);
+          vDfs.pop_back();
+        }
+      }
+      // build them
+      std::vector<lit> vNodes(I + A + 1);
+      vNodes[0] = Const0();
+      for(unsigned i = 0; i < I; i++)
+        vNodes[i + 1] = i < vValues.size() && vValues[i] >= 0? (lit)(vValues[i] != 0): IthVar(i);
+      size nHeld = 0;
+      unsigned nSample = 1 + nVars / 1024;
+      auto Release = [&](unsigned n) {
+        if(!--vCounts[n] && n > I)
+          DecRef(vNodes[n]), nHeld--;
+      };
+      for(size_t k = 0; k < vOrder.size(); k++) {
+        unsigned n = vOrder[k];
+        unsigned x = vFanins[2 * (n - I - 1)];
+        unsigned y = vFanins[2 * (n - I - 1) + 1];
+        vNodes[n] = And(LitNotCond(vNodes[x >> 1], x & 1), LitNotCond(vNodes[y >> 1], y & 1));
+        IncRef(vNodes[n]);
+        nHeld++;
+        Release(x >> 1);
+        Release(y >> 1);
+        // sample the live count
+        nReadPeakHeld = std::max(nReadPeakHeld, nHeld);
+        if(k % nSample == 0)
+          nReadPeakLive = std::max(nReadPeakLive, CountLive());
+      }
+      nReadPeakLive = std::max(nReadPeakLive, CountLive());
+      std::vector<lit> vLits(O);
+      for(unsigned i = 0; i < O; i++) {
+        vLits[i] = LitNotCond(vNodes[vPos[i] >> 1], vPos[i] & 1);
         IncRef(vLits[i]);
+        Release(vPos[i] >> 1);
+      }
+      if(nVerbose || fReoVerbose)
+        std::cout << "Read " << vOrder.size() << " of " << A << " ands: "
+                  << "peak " << nReadPeakLive << " live nodes, " << nReadPeakHeld << " held intermediates, "
+                  << nObjsAlloc << " nodes allocated" << std::endl;
+      return vLits;
+    }
+    // copy roots of another manager, unreferenced
+    std::vector<lit> Transfer(Man &src, std::vector<lit> const &vLits, std::vector<var> const &vVarMap = std::vector<var>()) {
+      if(vVarMap.empty() && src.nVars > nVars)
+        throw std::invalid_argument("Source manager has more variables");
+      if(!vVarMap.empty() && vVarMap.size() < src.nVars)
+        throw std::invalid_argument("Variable map is shorter than the source variables");
+      for(size_t v = 0; v < vVarMap.size(); v++)
+        if(vVarMap[v] >= nVars)
+          throw std::invalid_argument("Variable map exceeds the variables");
+      auto MapVar = [&](var v) { return vVarMap.empty()? v: vVarMap[v]; };
+      // nodes in post-order
+      std::vector<lit> vMap(src.nObjs, LitMax());
+      std::vector<bvar> vOrder;
+      std::vector<lit> vTodo;
+      std::vector<char> vUsed(src.nVars);
+      for(size_t i = 0; i < vLits.size(); i++) {
+        if(vLits[i] < 2)
+          continue;
+        vTodo.push_back(vLits[i]);
+        while(!vTodo.empty()) {
+          bvar a = Lit2Bvar(vTodo.back());
+          if(vMap[a] != LitMax()) {
+            vTodo.pop_back();
+            continue;
+          }
+          lit t = src.ThenOfBvar(a);
+          lit e = src.ElseOfBvar(a);
+          bool fReady = true;
+          if(t >= 2 && vMap[Lit2Bvar(t)] == LitMax())
+            vTodo.push_back(t), fReady = false;
+          if(e >= 2 && vMap[Lit2Bvar(e)] == LitMax())
+            vTodo.push_back(e), fReady = false;
+          if(!fReady)
+            continue;
+          vTodo.pop_back();
+          vMap[a] = 0;
+          vOrder.push_back(a);
+          vUsed[src.VarOfBvar(a)] = true;
+        }
+      }
+      bool fSameOrder = true;
+      int prev = -1;
+      for(var lev = 0; lev < src.nVars && fSameOrder; lev++) {
+        var v = src.Level2Var[lev];
+        if(!vUsed[v])
+          continue;
+        fSameOrder = (int)Var2Level[MapVar(v)] > prev;
+        prev = Var2Level[MapVar(v)];
+      }
+      auto Map = [&](lit x) {
+        return x < 2? x: LitNotCond(vMap[Lit2Bvar(x)], LitIsCompl(x));
+      };
+      for(size_t i = 0; i < vOrder.size(); i++) {
+        bvar a = vOrder[i];
+        var v = MapVar(src.VarOfBvar(a));
+        lit t = Map(src.ThenOfBvar(a));
+        lit e = Map(src.ElseOfBvar(a));
+        try {
+          vMap[a] = fSameOrder? UniqueCreate(v, t, e): Ite(IthVar(v), t, e);
+        } catch(...) {
+          for(size_t j = 0; j < i; j++)
+            DecRef(vMap[vOrder[j]]);
+          throw;
+        }
+        IncRef(vMap[a]);
+      }
+      std::vector<lit> vResults(vLits.size());
+      for(size_t i = 0; i < vLits.size(); i++)
+        vResults[i] = Map(vLits[i]);
+      for(size_t i = 0; i < vOrder.size(); i++)
+        DecRef(vMap[vOrder[i]]);
+      return vResults;
+    }
+    // map the roots into AND gates of w
+    std::vector<unsigned> ToAig(AigWriter &w, std::vector<lit> const &vLits) {
+      std::vector<unsigned> vMap(nObjs, ~0u);
+      auto Map = [&](lit x) {
+        return x < 2? (unsigned)x: vMap[Lit2Bvar(x)] ^ (unsigned)LitIsCompl(x);
+      };
+      for(size_t i = 0; i < vLits.size(); i++) {
+        if(vLits[i] < 2)
+          continue;
+        vStack.push_back(vLits[i]);
+        while(!vStack.empty()) {
+          bvar a = Lit2Bvar(vStack.back());
+          if(vMap[a] != ~0u) {
+            vStack.pop_back();
+            continue;
+          }
+          lit t = ThenOfBvar(a);
+          lit e = ElseOfBvar(a);
+          bool fReady = true;
+          if(t >= 2 && vMap[Lit2Bvar(t)] == ~0u)
+            vStack.push_back(t), fReady = false;
+          if(e >= 2 && vMap[Lit2Bvar(e)] == ~0u)
+            vStack.push_back(e), fReady = false;
+          if(!fReady)
+            continue;
+          vStack.pop_back();
+          vMap[a] = w.Mux(w.Input(VarOfBvar(a)), Map(t), Map(e));
+        }
+      }
+      std::vector<unsigned> vOutputs(vLits.size());
+      for(size_t i = 0; i < vLits.size(); i++)
+        vOutputs[i] = Map(vLits[i]);
+      return vOutputs;
+    }
+    // write the roots as a binary AIGER file
+    void WriteAiger(std::string const &name, std::vector<lit> const &vLits) {
+      AigWriter w(nVars);
+      w.Write(name, ToAig(w, vLits));
+    }
+    // rebuild the roots of a saved file
+    std::vector<lit> Load(Image const &img) {
+      if(img.NumVars() > nVars)
+        throw std::invalid_argument("Image has more variables than the manager");
+      bool fSameOrder = true;
+      for(var lev = 1; lev < img.NumVars(); lev++)
+        if(Var2Level[img.Level2Var(lev - 1)] > Var2Level[img.Level2Var(lev)])
+          fSameOrder = false;
+      std::vector<lit> vMap(img.NumNodes() + 1);
+      for(var lev = img.NumVars(); lev > 0; lev--) {
+        var v = img.Level2Var(lev - 1);
+        for(size i = img.Begin(lev - 1); i < img.End(lev - 1); i++) {
+          lit t = img.Then((lit)i << 1);
+          lit e = img.Else((lit)i << 1);
+          t = LitNotCond(vMap[t >> 1], LitIsCompl(t));
+          e = vMap[e >> 1];
+          vMap[i] = fSameOrder? UniqueCreate(v, t, e): Ite(IthVar(v), t, e);
+          IncRef(vMap[i]);
+        }
+      }
+      std::vector<lit> vLits(img.NumRoots());
+      for(size i = 0; i < img.NumRoots(); i++)
+        vLits[i] = LitNotCond(vMap[img.Root(i) >> 1], img.Root(i) & 1);
+      for(size i = 1; i <= img.NumNodes(); i++)
+        DecRef(vMap[i]);
+      return vLits;
+    }
+    std::vector<lit> Load(std::string const &name) {
+      Image img(name);
+      return Load(img);
     }
     void TurnOffReo() {
       nReo = BvarMax();
+      nReoCheck = SizeMax();
+    }
+    bvar CountLive() const {
+      bvar count = 1;
+      for(var v = 0; v < nVars; v++)
+        count += vUniqueCounts[v];
+      return count;
     }
     bvar CountNodes() {
       bvar count = 1;
@@ -759,36 +3476,473 @@ namespace NextBdd {
       }
       for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
         if(RefOfBvar(a))
-          count += CountNodes_rec(Bvar2Lit(a));
+          count += CountNodes_iter(Bvar2Lit(a));
       for(bvar a = 1; a <= (bvar)nVars; a++)
         ResetMarkOfBvar(a);
       for(bvar a = (bvar)nVars + 1; a < nObjs; a++)
         if(RefOfBvar(a))
-          ResetMark_rec(Bvar2Lit(a));
+          ResetMark_iter(Bvar2Lit(a));
       return count;
     }
     bvar CountNodes(std::vector<lit> const &vLits) {
       bvar count = 1;
       for(size_t i = 0; i < vLits.size(); i++)
-        count += CountNodes_rec(vLits[i]);
+        count += CountNodes_iter(vLits[i]);
       for(size_t i = 0; i < vLits.size(); i++)
-        ResetMark_rec(vLits[i]);
+        ResetMark_iter(vLits[i]);
       return count;
     }
+  private:
+    // density of x as m * 2^e
+    void SatFrac(lit x, double &m, int &e) {
+      struct num {
+        double m;
+        int    e;
+      };
+      typedef std::pair<num, num> frac;
+      std::unordered_map<bvar, frac> memo;
+      // (x + y) / 2
+      auto Half = [](num x, num y) {
+        if(x.m == 0)
+          std::swap(x, y);
+        if(y.m == 0) {
+          if(x.m != 0)
+            x.e--;
+          return x;
+        }
+        if(x.e < y.e)
+          std::swap(x, y);
+        num z;
+        z.m = std::frexp(x.m + std::ldexp(y.m, y.e - x.e), &z.e);
+        z.e += x.e - 1;
+        return z;
+      };
+      auto Get = [&](lit y, frac &f) {
+        if(y < 2) {
+          num one = {0.5, 1}, zero = {0, 0};
+          f = y? frac(one, zero): frac(zero, one);
+          return true;
+        }
+        auto it = memo.find(Lit2Bvar(y));
+        if(it == memo.end())
+          return false;
+        f = LitIsCompl(y)? frac(it->second.second, it->second.first): it->second;
+        return true;
+      };
+      vStack.push_back(x);
+      while(!vStack.empty()) {
+        bvar a = Lit2Bvar(vStack.back());
+        if(!a || memo.count(a)) {
+          vStack.pop_back();
+          continue;
+        }
+        frac f1, f0;
+        bool b1 = Get(ThenOfBvar(a), f1);
+        bool b0 = Get(ElseOfBvar(a), f0);
+        if(!b1)
+          vStack.push_back(ThenOfBvar(a));
+        if(!b0)
+          vStack.push_back(ElseOfBvar(a));
+        if(b1 && b0) {
+          memo[a] = frac(Half(f1.first, f0.first), Half(f1.second, f0.second));
+          vStack.pop_back();
+        }
+      }
+      frac f;
+      Get(x, f);
+      m = f.first.m;
+      e = f.first.e;
+    }
+
+  public:
+    // number of satisfying assignments
+    double SatCount(lit x) {
+      double m;
+      int e;
+      SatFrac(x, m, e);
+      return std::ldexp(m, e + (int)nVars);
+    }
+    // its log2, for any nVars; -inf for Const0
+    double SatCountLog2(lit x) {
+      double m;
+      int e;
+      SatFrac(x, m, e);
+      return std::log2(m) + e + (int)nVars;
+    }
+
+  private:
+    // one pass over W words of patterns
+    template <int W>
+    void SimulateBlock(std::vector<var> const &vVars_, std::vector<size_t> const &vFanins, std::vector<size_t> const &vRoots, std::vector<size> const &vPatterns, size_t nWords, size_t k, std::vector<size> &vValues, std::vector<size> &vResults) {
+      vValues.resize((vVars_.size() + 1) * W);
+      for(int j = 0; j < W; j++)
+        vValues[j] = 0;
+      for(size_t i = 0; i < vVars_.size(); i++) {
+        size const *x = &vPatterns[vVars_[i] * nWords + k];
+        size const *t = &vValues[(vFanins[2 * i] >> 1) * W];
+        size const *e = &vValues[(vFanins[2 * i + 1] >> 1) * W];
+        size c = (size)0 - (vFanins[2 * i] & 1);
+        size *r = &vValues[(i + 1) * W];
+        for(int j = 0; j < W; j++)
+          r[j] = (x[j] & (t[j] ^ c)) | (~x[j] & e[j]);
+      }
+      for(size_t o = 0; o < vRoots.size(); o++) {
+        size c = (size)0 - (vRoots[o] & 1);
+        for(int j = 0; j < W; j++)
+          vResults[o * nWords + k + j] = vValues[(vRoots[o] >> 1) * W + j] ^ c;
+      }
+    }
+
+  public:
+    // bit-parallel simulation of the roots
+    std::vector<size> Simulate(std::vector<lit> const &vLits, std::vector<size> const &vPatterns) {
+      if(!nVars || vPatterns.size() % nVars)
+        throw std::invalid_argument("Pattern words must be a multiple of nVars");
+      size_t nWords = vPatterns.size() / nVars;
+      std::unordered_map<bvar, size_t> m;
+      std::vector<var> vVars_;
+      std::vector<size_t> vFanins;
+      auto Get = [&](lit y, size_t &i) {
+        if(y < 2) {
+          i = y;
+          return true;
+        }
+        auto it = m.find(Lit2Bvar(y));
+        if(it == m.end())
+          return false;
+        i = (it->second << 1) | LitIsCompl(y);
+        return true;
+      };
+      for(size_t o = 0; o < vLits.size(); o++) {
+        vStack.push_back(vLits[o]);
+        while(!vStack.empty()) {
+          bvar a = Lit2Bvar(vStack.back());
+          if(!a || m.count(a)) {
+            vStack.pop_back();
+            continue;
+          }
+          size_t t, e;
+          bool b1 = Get(ThenOfBvar(a), t);
+          bool b0 = Get(ElseOfBvar(a), e);
+          if(!b1)
+            vStack.push_back(ThenOfBvar(a));
+          if(!b0)
+            vStack.push_back(ElseOfBvar(a));
+          if(b1 && b0) {
+            vVars_.push_back(VarOfBvar(a));
+            vFanins.push_back(t);
+            vFanins.push_back(e);
+            m[a] = vVars_.size();
+            vStack.pop_back();
+          }
+        }
+      }
+      std::vector<size_t> vRoots(vLits.size());
+      for(size_t o = 0; o < vLits.size(); o++)
+        Get(vLits[o], vRoots[o]);
+      std::vector<size> vValues, vResults(vLits.size() * nWords);
+      size_t k = 0;
+      for(; k + 8 <= nWords; k += 8)
+        SimulateBlock<8>(vVars_, vFanins, vRoots, vPatterns, nWords, k, vValues, vResults);
+      for(; k + 4 <= nWords; k += 4)
+        SimulateBlock<4>(vVars_, vFanins, vRoots, vPatterns, nWords, k, vValues, vResults);
+      for(; k < nWords; k++)
+        SimulateBlock<1>(vVars_, vFanins, vRoots, vPatterns, nWords, k, vValues, vResults);
+      return vResults;
+    }
     void PrintStats() {
       bvar nRemoved = 0;
       bvar a = RemovedHead;
       while(a)
-        a = vNexts[a], nRemoved++;
-      bvar nLive = 1;
-      for(var v = 0; v < nVars; v++)
-        nLive += vUniqueCounts[v];
-      std::cout << "ref: " << std::setw(10) << (vRefs.empty()? 0: CountNodes()) << ", "
+        a = NextOfBvar(a), nRemoved++;
+      bvar nLive = CountLive();
+      std::cout << "ref: " << std::setw(10) << (HasRefs()? CountNodes(): 0) << ", "
                 << "used: " << std::setw(10) << nObjs << ", "
                 << "live: " << std::setw(10) << nLive << ", "
                 << "dead: " << std::setw(10) << nRemoved << ", "
                 << "alloc: " << std::setw(10) << nObjsAlloc
                 << std::endl;
+      if(nReos)
+        std::cout << "reo: " << std::setw(10) << nReos << " times, "
+                  << "time: " << ReoTime << " s"
+                  << std::endl;
+      if(nReadPeakLive)
+        std::cout << "read: " << std::setw(10) << nReadPeakLive << " peak live, "
+                  << std::setw(10) << nReadPeakHeld << " peak held"
+                  << std::endl;
+      if(nMinorGbcs || nMajorGbcs)
+        std::cout << "gbc: " << std::setw(10) << nMinorGbcs << " minor, "
+                  << std::setw(10) << nMajorGbcs << " major, "
+                  << "freed: " << std::setw(10) << nGbcFreed << ", "
+                  << "time: " << GbcTime << " s, "
+                  << "max pause: " << GbcMaxPause << " s"
+                  << std::endl;
+      cache->PrintStats();
+    }
+  };
+
+  // counted reference to a node
+  class Bdd: private BddLink {
+  private:
+    Man *man;
+
+  public:
+    Bdd(): man(NULL) { x = 0; }
+    // fHeld: take over the reference of x
+    Bdd(Man &man_, lit x_, bool fHeld = false): man(&man_) {
+      x = x_;
+      if(!fHeld)
+        man->IncRef(x);
+      man->LinkBdd(this);
+    }
+    Bdd(Bdd &&b): man(b.man) {
+      x = b.x;
+      if(man) {
+        man->UnlinkBdd(&b);
+        man->LinkBdd(this);
+      }
+      b.man = NULL;
+    }
+    Bdd &operator=(Bdd &&b) {
+      if(this != &b) {
+        Reset();
+        man = b.man;
+        x = b.x;
+        if(man) {
+          man->UnlinkBdd(&b);
+          man->LinkBdd(this);
+        }
+        b.man = NULL;
+      }
+      return *this;
+    }
+    Bdd(Bdd const &) = delete;
+    Bdd &operator=(Bdd const &) = delete;
+    ~Bdd() { Reset(); }
+
+    void Reset() {
+      if(man) {
+        man->DecRef(x);
+        man->UnlinkBdd(this);
+      }
+      man = NULL;
+    }
+    // give up the handle without dropping its reference
+    lit Release() {
+      if(man)
+        man->UnlinkBdd(this);
+      man = NULL;
+      return x;
+    }
+    inline lit  Lit()    const { return x;    }
+    inline Man *GetMan() const { return man;  }
+    inline bool IsNull() const { return !man; }
+
+    static std::vector<lit> Lits(std::vector<Bdd> const &vBdds) {
+      std::vector<lit> vLits;
+      for(size_t i = 0; i < vBdds.size(); i++)
+        vLits.push_back(vBdds[i].Lit());
+      return vLits;
+    }
+  };
+
+  // jobs in their own managers sharing one budget
+  class ManPool {
+  public:
+    typedef std::function<std::vector<lit>(Man &)> Job;
+
+  private:
+    int    nThreads;
+    Budget budget;
+
+  public:
+    ManPool(int nThreads, size nNodes, size nEntries): nThreads(nThreads), budget(nNodes, nEntries) {}
+    Budget &GetBudget() { return budget; }
+    // each returned lit belongs to dst and holds one reference
+    std::vector<std::vector<lit> > Run(Man &dst, int nVars, Param p, std::vector<Job> const &vJobs) {
+      p.pBudget = &budget;
+      if(nThreads > 1)
+        p.nThreads = 1;
+      size_t n = vJobs.size();
+      std::vector<std::vector<lit> > vvResults(n);
+      std::vector<char> vRetry(n);
+      std::vector<std::exception_ptr> vErrors(n);
+      std::mutex m;
+      auto Build = [&](size_t k, bool fLast) {
+        bool fJob = true;
+        try {
+          Man man(nVars, p);
+          std::vector<lit> vLits = vJobs[k](man);
+          fJob = false;
+          std::lock_guard<std::mutex> l(m);
+          vvResults[k] = dst.Transfer(man, vLits);
+          for(size_t i = 0; i < vvResults[k].size(); i++)
+            dst.IncRef(vvResults[k][i]);
+        } catch(std::length_error const &e) {
+          if(fLast)
+            throw;
+          // retry only the job's own memouts
+          if(fJob && !std::strncmp(e.what(), "Memout", 6))
+            vRetry[k] = true;
+          else
+            vErrors[k] = std::current_exception();
+        } catch(...) {
+          if(fLast)
+            throw;
+          vErrors[k] = std::current_exception();
+        }
+      };
+      if(nThreads > 1) {
+        TaskPool pool(nThreads);
+        pool.For(n, [&](size_t k) { Build(k, false); });
+      } else
+        for(size_t k = 0; k < n; k++)
+          Build(k, false);
+      for(size_t k = 0; k < n; k++)
+        if(vErrors[k])
+          std::rethrow_exception(vErrors[k]);
+      for(size_t k = 0; k < n; k++)
+        if(vRetry[k])
+          Build(k, true);
+      return vvResults;
+    }
+  };
+
+  // outputs as disjunctions of cofactors by cubes
+  class Partitions {
+  private:
+    unsigned nInputs;
+    std::vector<std::vector<int> > vCubes;
+    std::vector<Man *>             vMans;
+    std::vector<std::vector<lit> > vvRoots;
+
+    void Clear() {
+      for(size_t i = 0; i < vMans.size(); i++)
+        delete vMans[i];
+      vMans.clear();
+    }
+
+  public:
+    Partitions(std::string const &name, Param p, int nThreads = 1, int nMaxSplits = 16) {
+      std::vector<unsigned> vPos, vFanins;
+      Man::ParseAiger(name, nInputs, vPos, vFanins);
+      std::vector<size> vFanouts(nInputs);
+      for(size_t i = 0; i < vFanins.size(); i++)
+        if((vFanins[i] >> 1) && (vFanins[i] >> 1) <= nInputs)
+          vFanouts[(vFanins[i] >> 1) - 1]++;
+      std::vector<var> vSplits(nInputs);
+      for(unsigned i = 0; i < nInputs; i++)
+        vSplits[i] = i;
+      std::stable_sort(vSplits.begin(), vSplits.end(), [&](var a, var b) { return vFanouts[a] > vFanouts[b]; });
+      if(nThreads > 1)
+        p.nThreads = 1;
+      TaskPool *pool = nThreads > 1? new TaskPool(nThreads): NULL;
+      std::vector<std::vector<int> > vWork(1, std::vector<int>(nInputs, -1));
+      try {
+        while(!vWork.empty()) {
+          size_t n = vWork.size();
+          std::vector<Man *> vNew(n, NULL);
+          std::vector<std::vector<lit> > vNewRoots(n);
+          std::vector<std::exception_ptr> vErrors(n);
+          auto Build = [&](size_t k) {
+            Man *man = NULL;
+            try {
+              man = new Man(nInputs, p);
+              vNewRoots[k] = man->ReadAiger(name, vWork[k]);
+              vNew[k] = man;
+            } catch(std::length_error const &e) {
+              // only running out of nodes is worth a split
+              if(!man || std::strcmp(e.what(), "Memout (node)"))
+                vErrors[k] = std::current_exception();
+              delete man;
+            } catch(...) {
+              delete man;
+              vErrors[k] = std::current_exception();
+            }
+          };
+          if(pool)
+            pool->For(n, Build);
+          else
+            for(size_t k = 0; k < n; k++)
+              Build(k);
+          std::vector<std::vector<int> > vNext;
+          for(size_t k = 0; k < n; k++) {
+            if(vNew[k]) {
+              vCubes.push_back(vWork[k]);
+              vMans.push_back(vNew[k]);
+              vvRoots.push_back(vNewRoots[k]);
+              continue;
+            }
+            if(vErrors[k])
+              continue;
+            int nFixed = 0;
+            for(unsigned i = 0; i < nInputs; i++)
+              nFixed += vWork[k][i] >= 0;
+            unsigned j = 0;
+            while(j < nInputs && vWork[k][vSplits[j]] >= 0)
+              j++;
+            if(nFixed >= nMaxSplits || j == nInputs)
+              throw std::length_error("Memout (node) in partition");
+            for(int c = 0; c < 2; c++) {
+              vNext.push_back(vWork[k]);
+              vNext.back()[vSplits[j]] = c;
+            }
+          }
+          for(size_t k = 0; k < n; k++)
+            if(vErrors[k])
+              std::rethrow_exception(vErrors[k]);
+          vWork.swap(vNext);
+        }
+      } catch(...) {
+        Clear();
+        delete pool;
+        throw;
+      }
+      delete pool;
+    }
+    ~Partitions() {
+      Clear();
+    }
+    Partitions(Partitions const &) = delete;
+    Partitions &operator=(Partitions const &) = delete;
+
+    size_t NumParts()                          const { return vMans.size();  }
+    size_t NumOutputs()                        const { return vvRoots.empty()? 0: vvRoots[0].size(); }
+    std::vector<int> const &Cube(size_t i)     const { return vCubes[i];     }
+    Man   &GetMan(size_t i)                    const { return *vMans[i];     }
+    lit    Root(size_t i, size_t o)            const { return vvRoots[i][o]; }
+    // number of input assignments under which output o is 1
+    double OneCount(size_t o) const {
+      double count = 0;
+      for(size_t i = 0; i < vMans.size(); i++) {
+        int nFixed = 0;
+        for(unsigned k = 0; k < nInputs; k++)
+          nFixed += vCubes[i][k] >= 0;
+        // the cube inputs are constants in the manager
+        count += std::ldexp(vMans[i]->SatCount(vvRoots[i][o]), -nFixed);
+      }
+      return count;
+    }
+    // compare the cofactors cube by cube
+    bool Equal(size_t o1, size_t o2) const {
+      for(size_t i = 0; i < vMans.size(); i++)
+        if(vvRoots[i][o1] != vvRoots[i][o2])
+          return false;
+      return true;
+    }
+    void WriteAiger(std::string const &name) const {
+      AigWriter w(nInputs);
+      std::vector<unsigned> vOutputs(NumOutputs(), 0);
+      for(size_t i = 0; i < vMans.size(); i++) {
+        std::vector<unsigned> vParts = vMans[i]->ToAig(w, vvRoots[i]);
+        unsigned cube = 1;
+        for(unsigned k = 0; k < nInputs; k++)
+          if(vCubes[i][k] >= 0)
+            cube = w.And(cube, w.Input(k) ^ (unsigned)!vCubes[i][k]);
+        for(size_t o = 0; o < vOutputs.size(); o++)
+          vOutputs[o] = w.Or(vOutputs[o], w.And(cube, vParts[o]));
+      }
+      w.Write(name, vOutputs);
     }
   };
 
@@ -0,0 +1,373 @@
+#include "aig.hpp"
+#include "NextBdd.h"
+
+#include <chrono>
+#include <random>
+#include <string>
+
+using namespace std;
+
+using namespace NextBdd;
+
+vector<lit> Build(aigman &aig, Man &man) {
+  vector<int> vCounts(aig.nObjs);
+  for(int i = aig.nPis + 1; i < aig.nObjs; i++)
+    vCounts[i] = aig.vvFanouts[i].size();
+  vector<lit> nodes(aig.nObjs);
+  nodes[0] = man.Const0();
+  for(int i = 0; i < aig.nPis; i++)
+    nodes[i + 1] = man.IthVar(i);
+  for(int i = aig.nPis + 1; i < aig.nObjs; i++) {
+    int i0 = aig.vObjs[i + i] >> 1;
+    int i1 = aig.vObjs[i + i + 1] >> 1;
+    bool c0 = aig.vObjs[i + i] & 1;
+    bool c1 = aig.vObjs[i + i + 1] & 1;
+    nodes[i] = man.And(man.LitNotCond(nodes[i0], c0), man.LitNotCond(nodes[i1], c1));
+    // a dangling AND is not kept
+    if(vCounts[i])
+      man.IncRef(nodes[i]);
+    vCounts[i0]--;
+    if(!vCounts[i0])
+      man.DecRef(nodes[i0]);
+    vCounts[i1]--;
+    if(!vCounts[i1])
+      man.DecRef(nodes[i1]);
+  }
+  vector<lit> outputs;
+  for(int i = 0; i < aig.nPos; i++) {
+    int i0 = aig.vPos[i] >> 1;
+    bool c0 = aig.vPos[i] & 1;
+    outputs.push_back(man.LitNotCond(nodes[i0], c0));
+  }
+  return outputs;
+}
+
+// the cone of one output alone
+vector<lit> BuildCone(aigman &aig, Man &man, int o) {
+  vector<int> vCounts(aig.nObjs);
+  vector<bool> vMarks(aig.nObjs);
+  vector<int> vStack(1, aig.vPos[o] >> 1);
+  while(!vStack.empty()) {
+    int i = vStack.back();
+    vStack.pop_back();
+    if(i <= aig.nPis || vMarks[i])
+      continue;
+    vMarks[i] = true;
+    for(int k = 0; k < 2; k++) {
+      vCounts[aig.vObjs[i + i + k] >> 1]++;
+      vStack.push_back(aig.vObjs[i + i + k] >> 1);
+    }
+  }
+  vector<lit> nodes(aig.nObjs);
+  nodes[0] = man.Const0();
+  for(int i = 0; i < aig.nPis; i++)
+    nodes[i + 1] = man.IthVar(i);
+  for(int i = aig.nPis + 1; i < aig.nObjs; i++) {
+    if(!vMarks[i])
+      continue;
+    int i0 = aig.vObjs[i + i] >> 1;
+    int i1 = aig.vObjs[i + i + 1] >> 1;
+    nodes[i] = man.And(man.LitNotCond(nodes[i0], aig.vObjs[i + i] & 1), man.LitNotCond(nodes[i1], aig.vObjs[i + i + 1] & 1));
+    man.IncRef(nodes[i]);
+    if(!--vCounts[i0])
+      man.DecRef(nodes[i0]);
+    if(!--vCounts[i1])
+      man.DecRef(nodes[i1]);
+  }
+  return vector<lit>(1, man.LitNotCond(nodes[aig.vPos[o] >> 1], aig.vPos[o] & 1));
+}
+
+double Elapsed(chrono::steady_clock::time_point start) {
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// parity and mux chain, natively or from And
+lit Parity(Man &man, vector<lit> const &outputs, bool fNative) {
+  lit x = man.Const0();
+  man.IncRef(x);
+  for(size_t i = 0; i < outputs.size(); i++) {
+    lit y;
+    if(fNative)
+      y = man.Xor(x, outputs[i]);
+    else {
+      lit a = man.And(x, man.LitNot(outputs[i]));
+      man.IncRef(a);
+      lit b = man.And(man.LitNot(x), outputs[i]);
+      man.IncRef(b);
+      y = man.Or(a, b);
+      man.DecRef(a);
+      man.DecRef(b);
+    }
+    man.IncRef(y);
+    man.DecRef(x);
+    x = y;
+  }
+  return x;
+}
+lit Mux(Man &man, vector<lit> const &outputs, bool fNative) {
+  lit x = man.Const0();
+  man.IncRef(x);
+  for(size_t i = 0; i + 1 < outputs.size(); i += 2) {
+    lit y;
+    if(fNative)
+      y = man.Ite(outputs[i], outputs[i + 1], x);
+    else {
+      lit a = man.And(outputs[i], outputs[i + 1]);
+      man.IncRef(a);
+      lit b = man.And(man.LitNot(outputs[i]), x);
+      man.IncRef(b);
+      y = man.Or(a, b);
+      man.DecRef(a);
+      man.DecRef(b);
+    }
+    man.IncRef(y);
+    man.DecRef(x);
+    x = y;
+  }
+  return x;
+}
+
+int main(int argc, char **argv) {
+  if(argc < 2) {
+    cout << "usage: bench <aig> [threads|xor|layout|sift|save|read|part|pool|compact|sim|cache]" << endl;
+    return 1;
+  }
+  aigman aig(argv[1]);
+  aig.supportfanouts();
+  string mode = argc > 2? argv[2]: "threads";
+
+  Param p;
+  p.nObjsAllocLog = ceil(log2(aig.nPis)) + 1;
+  p.nUniqueSizeLog = 0;
+  p.nCacheSizeLog = 10;
+  p.nGbc = 2;
+
+  if(mode == "threads") {
+    // speedup of the parallel apply over the serial one
+    int nMax = thread::hardware_concurrency();
+    double base = 0;
+    for(int n = 1; n <= max(nMax, 1); n <<= 1) {
+      p.nThreads = n;
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      Man man(aig.nPis, p);
+      vector<lit> outputs = Build(aig, man);
+      bvar count = man.CountNodes(outputs);
+      double t = Elapsed(start);
+      if(n == 1)
+        base = t;
+      cout << "threads: " << setw(3) << n << ", "
+           << "nodes: " << setw(10) << count << ", "
+           << "time: " << setw(10) << t << " s, "
+           << "speedup: " << setw(6) << base / t << endl;
+    }
+  } else if(mode == "xor") {
+    // native xor/ite against their and-compositions
+    for(int fNative = 0; fNative < 2; fNative++) {
+      Man man(aig.nPis, p);
+      vector<lit> outputs = Build(aig, man);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      lit x = Parity(man, outputs, fNative);
+      double t1 = Elapsed(start);
+      start = chrono::steady_clock::now();
+      lit y = Mux(man, outputs, fNative);
+      double t2 = Elapsed(start);
+      cout << (fNative? "native  : ": "composed: ")
+           << "xor: " << setw(10) << t1 << " s (" << setw(8) << man.CountNodes(vector<lit>(1, x)) << " nodes), "
+           << "ite: " << setw(10) << t2 << " s (" << setw(8) << man.CountNodes(vector<lit>(1, y)) << " nodes)" << endl;
+      man.PrintStats();
+    }
+  } else if(mode == "layout") {
+    // layout of this binary
+#ifdef NEXT_BDD_PACKED
+    cout << "layout: packed, ";
+#else
+    cout << "layout: arrays, ";
+#endif
+#ifdef NEXT_BDD_OPEN
+    cout << "unique: open, ";
+#else
+    cout << "unique: chained, ";
+#endif
+    p.nReo = 100;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Man man(aig.nPis, p);
+    vector<lit> outputs = Build(aig, man);
+    double t1 = Elapsed(start);
+    start = chrono::steady_clock::now();
+    bvar count = 0;
+    for(int i = 0; i < 10; i++)
+      count = man.CountNodes(outputs);
+    double t2 = Elapsed(start);
+    cout << "nodes: " << setw(10) << count << ", "
+         << "build: " << setw(10) << t1 << " s, "
+         << "count: " << setw(10) << t2 << " s" << endl;
+  } else if(mode == "sift") {
+    // plain, bounded and cost-aware sifting
+    char const *names[] = {"plain   : ", "bound   : ", "cost    : "};
+    for(int k = 0; k < 3; k++) {
+      p.fSiftBound = k == 1;
+      p.fSiftCost = k == 2;
+      Man man(aig.nPis, p);
+      vector<lit> outputs = Build(aig, man);
+      bvar count = man.CountNodes(outputs);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      man.Reorder();
+      double t = Elapsed(start);
+      cout << names[k]
+           << "nodes: " << setw(10) << count << " -> " << setw(10) << man.CountNodes(outputs) << ", "
+           << "reorder: " << setw(10) << t << " s" << endl;
+    }
+  } else if(mode == "save") {
+    // cold build against a warm start from a saved file
+    string name = string(argv[1]) + ".nbdd";
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Man man(aig.nPis, p);
+    vector<lit> outputs = Build(aig, man);
+    double t1 = Elapsed(start);
+    start = chrono::steady_clock::now();
+    man.Save(name, outputs);
+    double t2 = Elapsed(start);
+    start = chrono::steady_clock::now();
+    Man man2(aig.nPis, p);
+    vector<lit> outputs2 = man2.Load(name);
+    double t3 = Elapsed(start);
+    start = chrono::steady_clock::now();
+    Image img(name);
+    double t4 = Elapsed(start);
+    cout << "nodes: " << setw(10) << img.NumNodes() << ", "
+         << "build: " << setw(10) << t1 << " s, "
+         << "save: " << setw(10) << t2 << " s, "
+         << "load: " << setw(10) << t3 << " s, "
+         << "map: " << setw(10) << t4 << " s" << endl;
+  } else if(mode == "read") {
+    // the library reader against the file-order build above
+    for(int fLib = 0; fLib < 2; fLib++) {
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      Man man(aig.nPis, p);
+      vector<lit> outputs = fLib? man.ReadAiger(argv[1]): Build(aig, man);
+      double t = Elapsed(start);
+      cout << (fLib? "reader: ": "build : ")
+           << "nodes: " << setw(10) << man.CountNodes(outputs) << ", "
+           << "time: " << setw(10) << t << " s" << endl;
+      man.PrintStats();
+    }
+  } else if(mode == "part") {
+    // build within a node limit too small for the whole graph
+    for(int nMaxLog = 20; nMaxLog >= 14; nMaxLog -= 2) {
+      p.nObjsMaxLog = nMaxLog;
+      p.nObjsAllocLog = min(p.nObjsAllocLog, nMaxLog);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      Partitions parts(argv[1], p, thread::hardware_concurrency());
+      double t = Elapsed(start);
+      cout << "max: 2^" << nMaxLog << ", "
+           << "parts: " << setw(6) << parts.NumParts() << ", "
+           << "ones: " << setw(12) << parts.OneCount(0) << ", "
+           << "time: " << setw(10) << t << " s" << endl;
+    }
+  } else if(mode == "pool") {
+    // cones in a shared budget, merged into one manager
+    int nThreads = thread::hardware_concurrency();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Man man(aig.nPis, p);
+    vector<lit> outputs = Build(aig, man);
+    double t1 = Elapsed(start);
+    vector<ManPool::Job> vJobs;
+    for(int i = 0; i < aig.nPos; i++)
+      vJobs.push_back([&aig, i](Man &m) { return BuildCone(aig, m, i); });
+    ManPool pool(nThreads, 1 << 24, 1 << 22);
+    start = chrono::steady_clock::now();
+    Man dst(aig.nPis, p);
+    vector<vector<lit> > vvResults = pool.Run(dst, aig.nPis, p, vJobs);
+    double t2 = Elapsed(start);
+    vector<lit> merged;
+    for(size_t i = 0; i < vvResults.size(); i++)
+      merged.push_back(vvResults[i][0]);
+    cout << "single: " << setw(10) << t1 << " s, "
+         << "pool: " << setw(10) << t2 << " s with " << nThreads << " threads, "
+         << "nodes: " << setw(10) << man.CountNodes(outputs) << " / " << setw(10) << dst.CountNodes(merged) << endl;
+  } else if(mode == "compact") {
+    // the same operations on a scattered graph and after compacting it
+    for(int fCompact = 0; fCompact < 3; fCompact++) {
+      Man man(aig.nPis, p);
+      vector<lit> outputs = Build(aig, man);
+      man.Gbc();
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      if(fCompact)
+        man.Compact(outputs, fCompact == 1);
+      double t1 = Elapsed(start);
+      start = chrono::steady_clock::now();
+      man.TurnOffReo();
+      lit x = Parity(man, outputs, true);
+      double t2 = Elapsed(start);
+      cout << (fCompact == 0? "none : ": fCompact == 1? "dfs  : ": "level: ")
+           << "nodes: " << setw(10) << man.CountNodes(outputs) << ", "
+           << "compact: " << setw(10) << t1 << " s, "
+           << "xor: " << setw(10) << t2 << " s (" << setw(8) << man.CountNodes(vector<lit>(1, x)) << " nodes)" << endl;
+      man.PrintStats();
+    }
+  } else if(mode == "sim") {
+    // random patterns walked one at a time against the packed simulation
+    Man man(aig.nPis, p);
+    vector<lit> outputs = Build(aig, man);
+    int nWords = 1 << 10;
+    vector<NextBdd::size> vPatterns((size_t)aig.nPis * nWords);
+    mt19937_64 rng(1);
+    for(size_t i = 0; i < vPatterns.size(); i++)
+      vPatterns[i] = rng();
+    int nWalks = 1 << 12;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t ones = 0;
+    for(int k = 0; k < nWalks; k++)
+      for(size_t o = 0; o < outputs.size(); o++) {
+        lit x = outputs[o];
+        while(x >= 2)
+          x = (vPatterns[(size_t)man.Var(x) * nWords + k / 64] >> (k % 64)) & 1? man.Then(x): man.Else(x);
+        ones += x;
+      }
+    double t1 = Elapsed(start);
+    start = chrono::steady_clock::now();
+    vector<NextBdd::size> vResults = man.Simulate(outputs, vPatterns);
+    double t2 = Elapsed(start);
+    cout << "walk: " << setw(10) << nWalks / t1 << " patterns/s, "
+         << "simulate: " << setw(10) << 64.0 * nWords / t2 << " patterns/s, "
+         << "ones: " << ones << endl;
+    // every pattern walked again against the packed results
+    size_t nMismatches = 0;
+    for(size_t o = 0; o < outputs.size(); o++)
+      for(int w = 0; w < nWords; w++) {
+        NextBdd::size word = 0;
+        for(int b = 0; b < 64; b++) {
+          lit x = outputs[o];
+          while(x >= 2)
+            x = (vPatterns[(size_t)man.Var(x) * nWords + w] >> b) & 1? man.Then(x): man.Else(x);
+          word |= (NextBdd::size)x << b;
+        }
+        nMismatches += word != vResults[o * nWords + w];
+      }
+    if(nMismatches) {
+      cout << "simulate: " << nMismatches << " mismatching words" << endl;
+      return 1;
+    }
+  } else if(mode == "cache") {
+    // hit rates of a direct-mapped table against 2 and 4 ways
+    for(int nWays = 1; nWays <= 4; nWays <<= 1) {
+      p.nCacheWays = nWays;
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+      Man man(aig.nPis, p);
+      vector<lit> outputs = Build(aig, man);
+      man.TurnOffReo();
+      lit x = Parity(man, outputs, true);
+      double t = Elapsed(start);
+      cout << "ways: " << nWays << ", "
+           << "nodes: " << setw(10) << man.CountNodes(vector<lit>(1, x)) << ", "
+           << "time: " << setw(10) << t << " s" << endl;
+      man.PrintStats();
+    }
+  } else {
+    cout << "unknown mode " << mode << endl;
+    return 1;
+  }
+
+  return 0;
+}